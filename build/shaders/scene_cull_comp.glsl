@@ -0,0 +1,42 @@
+#version 450 core
+layout (local_size_x = 64) in;
+
+struct draw_command
+{
+    uint count;
+    uint instance_count;
+    uint first_index;
+    int  base_vertex;
+    uint base_instance;
+};
+
+//xyz = position, w = rotation offset in degrees
+layout (std430, binding = 0) readonly buffer instance_buffer { vec4 instances[]; };
+layout (std430, binding = 1) writeonly buffer visible_buffer { uint visible_ids[]; };
+layout (std430, binding = 2) buffer command_buffer { draw_command commands[]; };
+
+uniform vec4  u_planes[6];
+uniform float u_radius;
+uniform uint  u_instance_count;
+uniform bool  u_cull;
+
+void main()
+{
+    //Groups go on to more rows once a row holds the most groups a dispatch allows
+    uint id = gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x + gl_GlobalInvocationID.x;
+    if(id >= u_instance_count) {
+        return;
+    }
+
+    if(u_cull) {
+        vec3 center = instances[id].xyz;
+        for(int i = 0; i < 6; ++i) {
+            if(dot(u_planes[i].xyz, center) + u_planes[i].w < -u_radius) {
+                return;
+            }
+        }
+    }
+
+    uint slot = atomicAdd(commands[0].instance_count, 1u);
+    visible_ids[slot] = id;
+}
@@ -0,0 +1,33 @@
+#version 450 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+
+//xyz = position, w = rotation offset in degrees
+layout (std430, binding = 0) readonly buffer instance_buffer { vec4 instances[]; };
+layout (std430, binding = 1) readonly buffer visible_buffer { uint visible_ids[]; };
+
+out vec2 TexCoord;
+
+uniform mat4  u_proj_view;
+uniform float u_rot;
+
+//Same rotation as mat4_rotate_make
+mat3 rotate_make(float angle, vec3 axis)
+{
+    float c = cos(angle);
+    vec3 v  = axis * (1.0 - c);
+    vec3 vs = axis * sin(angle);
+
+    return mat3(axis * v.x + vec3(c, vs.z, -vs.y),
+                axis * v.y + vec3(-vs.z, c, vs.x),
+                axis * v.z + vec3(vs.y, -vs.x, c));
+}
+
+void main()
+{
+    vec4 instance = instances[visible_ids[gl_InstanceID]];
+    mat3 rot = rotate_make(radians(u_rot + instance.w), normalize(vec3(1.0, 0.3, 0.5)));
+
+    gl_Position = u_proj_view * vec4(rot * aPos + instance.xyz, 1.0f);
+    TexCoord = vec2(aTexCoord.x, 1.0 - aTexCoord.y);
+}
@@ -0,0 +1,14 @@
+#version 450 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in mat4 aModel;
+
+out vec2 TexCoord;
+
+uniform mat4 u_proj_view;
+
+void main()
+{
+    gl_Position = u_proj_view * aModel * vec4(aPos, 1.0f);
+    TexCoord = vec2(aTexCoord.x, 1.0 - aTexCoord.y);
+}
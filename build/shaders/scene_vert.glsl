@@ -5,9 +5,12 @@ layout (location = 1) in vec2 aTexCoord;
 out vec2 TexCoord;
 
 uniform mat4 u_proj_view;
+//Packed vertices store positions relative to the batch bounds, float vertices use 0 and 1
+uniform vec3 u_origin = vec3(0.0);
+uniform vec3 u_extent = vec3(1.0);
 
 void main()
 {
-    gl_Position = u_proj_view * vec4(aPos, 1.0f);
+    gl_Position = u_proj_view * vec4(u_origin + aPos * u_extent, 1.0f);
     TexCoord = vec2(aTexCoord.x, 1.0 - aTexCoord.y);
 }
@@ -3,13 +3,26 @@
 out vec4 FragColor;
 
 in vec2 vUV;
-in float vAtlasIndex;
+in vec4 vColor;
+flat in uint vLayer;
 
-uniform sampler2D u_atlases[1];
+uniform sampler2DArray u_atlas;
+uniform uint  u_sdf_layers;
+uniform uint  u_solid_layer; //TEXT_SOLID_LAYER
+uniform float u_sdf_edge;    //FONT_SDF_ON_EDGE / 255, the value distance fields have on the glyph edge
 
 void main()
 {
-	int index = int(vAtlasIndex);
-	vec4 tex = texture(u_atlases[index], vUV);
-	FragColor = vec4(1.0f, 1.0f, 1.0f, tex.r);
+	float value = texture(u_atlas, vec3(vUV, vLayer)).r;
+
+	//Derivatives are taken outside the branch
+	float width = fwidth(value);
+	float alpha = value;
+	if(vLayer >= u_solid_layer) {
+		//Solid quads for bars and graphs, past every font layer
+		alpha = 1.0f;
+	} else if((u_sdf_layers & (1u << vLayer)) != 0u) {
+		alpha = smoothstep(u_sdf_edge - width, u_sdf_edge + width, value);
+	}
+	FragColor = vec4(vColor.rgb, vColor.a * alpha);
 } 
@@ -1,16 +1,25 @@
 #version 450 core
 layout (location = 0) in vec2 aPos;
-layout (location = 1) in vec2 aUV;
-layout (location = 2) in float aAtlasIndex;
+layout (location = 1) in vec2 aSize;
+layout (location = 2) in vec4 aUV;
+layout (location = 3) in vec4 aColor;
+layout (location = 4) in uint aLayer;
 
 uniform mat4 u_proj;
 
 out vec2 vUV;
-out float vAtlasIndex;
+out vec4 vColor;
+flat out uint vLayer;
 
 void main()
 {
-	vUV = aUV;
-	vAtlasIndex = aAtlasIndex;
-	gl_Position = u_proj * vec4(aPos, 1.0, 1.0);
+	//Drawn as a 4 vertex strip, bit 0 picks the right side and bit 1 the top
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	vec2 pos = (aPos + aSize * corner) * 0.25f;
+
+	//The top of the glyph is at the smaller v
+	vUV = vec2(mix(aUV.x, aUV.z, corner.x), mix(aUV.w, aUV.y, corner.y));
+	vColor = aColor;
+	vLayer = aLayer;
+	gl_Position = u_proj * vec4(pos, 1.0, 1.0);
 }
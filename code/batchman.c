@@ -1,4 +1,8 @@
 #include <stdbool.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "gl.c"
 #include <SDL.h>
 #include <SDL_opengl.h>
@@ -11,21 +15,65 @@
 
 #include "generics.h"
 #include "bmath.h"
+#include "files.h"
 
 #include "graphics_generics.h"
 #include "graphics.h"
 
 #include "text.c"
 
+#include "jobs.h"
+#include "scene.h"
+#include "voxel.h"
+#include "perf.h"
+
 #define TEXT_VERT_PATH  "shaders/text_vert.glsl"
 #define TEXT_FRAG_PATH  "shaders/text_frag.glsl"
 #define SCENE_VERT_PATH "shaders/scene_vert.glsl"
 #define SCENE_FRAG_PATH "shaders/scene_frag.glsl"
-
-#define HUD_MAX_QUAD_COUNT  1000
-#define HUD_MAX_INDEX_COUNT HUD_MAX_QUAD_COUNT * 6
-
-#define SCENE_MAX_CUBES 2050
+#define SCENE_INSTANCED_VERT_PATH "shaders/scene_instanced_vert.glsl"
+#define SCENE_GPU_VERT_PATH "shaders/scene_gpu_vert.glsl"
+#define SCENE_CULL_COMP_PATH "shaders/scene_cull_comp.glsl"
+
+//Rasterized glyphs are kept here between runs
+#define FONT_CACHE_DIR "res/fonts"
+
+#define HUD_MAX_GLYPHS      1000
+#define HUD_MAX_TEXTS       32
+#define HUD_MAX_FONTS       4
+#define HUD_ROW_COUNT       7
+
+//Glyphs per region of the console stream, longer consoles are drawn in several flushes
+#define CONSOLE_STREAM_GLYPHS 16384
+#define CONSOLE_TEXT_SIZE     0.5f
+#define CONSOLE_SCROLL_LINES  3
+
+//The perf overlay fits in one region, its graph is a quad per frame of history
+#define PERF_STREAM_GLYPHS    1024
+
+#define SCENE_DEFAULT_CUBES 2050
+
+//Cubes that fit in one stream region, bigger scenes are drawn in several flushes
+#define SCENE_CHUNK_CUBES     4096
+#define SCENE_CHUNK_INSTANCES 16384
+
+/*
+  Batched:   every cube is transformed on the cpu and the whole vertex array is uploaded every frame
+  Instanced: a single cube is uploaded once and only one model matrix per cube is uploaded every frame
+  Gpu:       cube positions live on the gpu, a compute shader culls them and fills an indirect draw,
+             the cpu does no work per cube
+  Voxel:     the same cubes without rotation packed into a solid grid, meshed once with hidden faces
+             removed and coplanar faces merged
+*/
+typedef enum {
+	SCENE_MODE_BATCHED,
+	SCENE_MODE_INSTANCED,
+	SCENE_MODE_GPU,
+	SCENE_MODE_VOXEL,
+	SCENE_MODE_COUNT
+} scene_mode;
+
+static const char* scene_mode_names[SCENE_MODE_COUNT] = { "batched", "instanced", "gpu", "voxel" };
 
 typedef struct {
 	vec3 pos;
@@ -49,6 +97,7 @@ gl_debug_output(GLenum source,
 typedef struct {
 	i32 xrel;
 	i32 yrel;
+	i32 wheel;
 	u32 requests;
 } events_data;
 
@@ -60,6 +109,12 @@ typedef struct {
 #define EVENT_RIGHT       (1 << 5)
 #define EVENT_MODE_CHANGE (1 << 6)
 #define EVENT_MODE_TEXT   (1 << 7)
+#define EVENT_MODE_VERTEX (1 << 8)
+#define EVENT_MODE_CULL   (1 << 9)
+#define EVENT_MODE_INDEX  (1 << 10)
+#define EVENT_MODE_FONT   (1 << 11)
+#define EVENT_MODE_CONSOLE (1 << 12)
+#define EVENT_MODE_PERF    (1 << 13)
 
 static const events_data
 handle_events(const SDL_Event* event, const events_data previous_data) {
@@ -78,6 +133,11 @@ handle_events(const SDL_Event* event, const events_data previous_data) {
 			new_data.yrel = event->motion.yrel;
 		} break;
 
+		case SDL_MOUSEWHEEL:
+		{
+			new_data.wheel += event->wheel.y;
+		} break;
+
 		case SDL_WINDOWEVENT:
 		{
 			switch(event->window.event)
@@ -127,6 +187,27 @@ handle_events(const SDL_Event* event, const events_data previous_data) {
 					new_data.requests |= EVENT_MODE_TEXT;
 				}
 
+				if(keycode == SDLK_v) {
+					new_data.requests |= EVENT_MODE_VERTEX;
+				}
+
+				if(keycode == SDLK_c) {
+					new_data.requests |= EVENT_MODE_CULL;
+				}
+
+				if(keycode == SDLK_i) {
+					new_data.requests |= EVENT_MODE_INDEX;
+				}
+				if(keycode == SDLK_g) {
+					new_data.requests |= EVENT_MODE_FONT;
+				}
+				if(keycode == SDLK_l) {
+					new_data.requests |= EVENT_MODE_CONSOLE;
+				}
+				if(keycode == SDLK_p) {
+					new_data.requests |= EVENT_MODE_PERF;
+				}
+
 				if(keycode == SDLK_ESCAPE) {
 					new_data.requests |= EVENT_CLOSE;
 				}
@@ -153,7 +234,184 @@ handle_events(const SDL_Event* event, const events_data previous_data) {
 	return new_data;
 }
 
+/*
+  Everything the flushes of the batched and instanced modes need to build and draw one chunk.
+  A flush charges the time since the last mark to Build, that's the culling and pushing of its cubes plus the
+  build jobs, which also write the chunk straight into its mapped region so the scene upload is part of Build.
+  The draw calls after that go to Draw
+*/
+typedef struct {
+	job_pool*            pool;
+	scene_build_job      job;
+	bool                 packed;
+	stream_vertex_array* scene_vao;
+	u32                  u_origin;
+	u32                  u_extent;
+	bool                 shared_indices;
+	const i32*           index_counts;
+	const void* const*   index_offsets;
+	const i32*           base_vertices;
+	u32                  instanced_vao;
+	stream_buffer*       instance_stream;
+	perf_stats*          perf;
+} scene_flush_context;
+
+static void
+scene_flush_batched(const i32* ids, const i32 count, void* user_data) {
+	scene_flush_context* ctx = (scene_flush_context*)user_data;
+	scene_build_job* job = &ctx->job;
+	vec3 origin = { 0.0f, 0.0f, 0.0f };
+	vec3 extent = { 1.0f, 1.0f, 1.0f };
+
+	job->ids = ids;
+
+	if(ctx->packed) {
+		vec3 min, max;
+		scene_cube_bounds(ids, count, min, max);
+		for(i32 i=0; i<3; ++i) {
+			origin[i] = (min[i] + max[i]) * 0.5f;
+			extent[i] = (max[i] - min[i]) * 0.5f;
+			job->inv_extent[i] = 1.0f / extent[i];
+		}
+		vec3_copy(origin, job->origin);
+
+		job->packed_cubes = (packed_cube*)stream_buffer_begin(&ctx->scene_vao->vbo);
+		job_parallel_for(ctx->pool, count, SCENE_JOB_MIN_BATCH, scene_build_packed_range, job);
+		perf_mark(ctx->perf, PERF_STAGE_BUILD);
+		stream_vao_bind_region(ctx->scene_vao, sizeof(packed_scene_vertex));
+	} else {
+		job->cubes = (cube*)stream_buffer_begin(&ctx->scene_vao->vbo);
+		job_parallel_for(ctx->pool, count, SCENE_JOB_MIN_BATCH, scene_build_batched_range, job);
+		perf_mark(ctx->perf, PERF_STAGE_BUILD);
+		stream_vao_bind_region(ctx->scene_vao, sizeof(scene_vertex));
+	}
+
+	glUniform3fv(ctx->u_origin, 1, origin);
+	glUniform3fv(ctx->u_extent, 1, extent);
+
+	//Shared indices draw every cube of the chunk with the same 36 indices offset by its base vertex
+	if(ctx->shared_indices) {
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, ctx->index_counts, GL_UNSIGNED_SHORT, ctx->index_offsets, count, ctx->base_vertices);
+	} else {
+		glDrawElements(GL_TRIANGLES, count * 36, GL_UNSIGNED_INT, 0);
+	}
+	stream_buffer_end(&ctx->scene_vao->vbo);
+	perf_mark(ctx->perf, PERF_STAGE_DRAW);
+}
+
+static void
+scene_flush_instanced(const i32* ids, const i32 count, void* user_data) {
+	scene_flush_context* ctx = (scene_flush_context*)user_data;
+	scene_build_job* job = &ctx->job;
+
+	job->ids = ids;
+	job->instances = (mat4*)stream_buffer_begin(ctx->instance_stream);
+	job_parallel_for(ctx->pool, count, SCENE_JOB_MIN_BATCH, scene_build_instanced_range, job);
+	perf_mark(ctx->perf, PERF_STAGE_BUILD);
+
+	glVertexArrayVertexBuffer(ctx->instanced_vao, 1, ctx->instance_stream->id, stream_buffer_offset(ctx->instance_stream), sizeof(mat4));
+
+	glDrawElementsInstanced(GL_TRIANGLES, 36, GL_UNSIGNED_SHORT, 0, count);
+	stream_buffer_end(ctx->instance_stream);
+	perf_mark(ctx->perf, PERF_STAGE_DRAW);
+}
+
+//Every program of the demo with the uniform locations it is drawn with, a reload builds a new set
+//and only replaces the old one, deleting it, once all of them compiled
+typedef struct {
+	shader_program_id text;
+	shader_program_id scene;
+	shader_program_id instanced;
+	shader_program_id gpu;
+	shader_program_id cull;
+
+	u32 u_text_proj;
+	u32 u_text_sdf_layers;
+	u32 u_text_solid_layer;
+	u32 u_text_sdf_edge;
+	u32 u_proj_view;
+	u32 u_origin;
+	u32 u_extent;
+	u32 u_instanced_proj_view;
+	u32 u_gpu_proj_view;
+	u32 u_gpu_rot;
+	u32 u_cull_planes;
+	u32 u_cull_radius;
+	u32 u_cull_count;
+	u32 u_cull_enabled;
+} shader_programs;
+
+static void
+shader_programs_destroy(shader_programs* p) {
+	//Deleting 0 is ignored, so a partially created set can be destroyed as well
+	glDeleteProgram(p->text);
+	glDeleteProgram(p->scene);
+	glDeleteProgram(p->instanced);
+	glDeleteProgram(p->gpu);
+	glDeleteProgram(p->cull);
+}
+
+static bool
+shader_programs_create(shader_programs* p) {
+	p->text      = load_create_shader_program(TEXT_VERT_PATH, TEXT_FRAG_PATH);
+	p->scene     = load_create_shader_program(SCENE_VERT_PATH, SCENE_FRAG_PATH);
+	p->instanced = load_create_shader_program(SCENE_INSTANCED_VERT_PATH, SCENE_FRAG_PATH);
+	p->gpu       = load_create_shader_program(SCENE_GPU_VERT_PATH, SCENE_FRAG_PATH);
+	p->cull      = load_create_compute_program(SCENE_CULL_COMP_PATH);
+	if(!p->text || !p->scene || !p->instanced || !p->gpu || !p->cull) {
+		shader_programs_destroy(p);
+		return false;
+	}
+
+	p->u_text_proj        = glGetUniformLocation(p->text, "u_proj");
+	p->u_text_sdf_layers  = glGetUniformLocation(p->text, "u_sdf_layers");
+	p->u_text_solid_layer = glGetUniformLocation(p->text, "u_solid_layer");
+	p->u_text_sdf_edge    = glGetUniformLocation(p->text, "u_sdf_edge");
+	p->u_proj_view  = glGetUniformLocation(p->scene, "u_proj_view");
+	p->u_origin     = glGetUniformLocation(p->scene, "u_origin");
+	p->u_extent     = glGetUniformLocation(p->scene, "u_extent");
+	p->u_instanced_proj_view = glGetUniformLocation(p->instanced, "u_proj_view");
+	p->u_gpu_proj_view = glGetUniformLocation(p->gpu, "u_proj_view");
+	p->u_gpu_rot       = glGetUniformLocation(p->gpu, "u_rot");
+	p->u_cull_planes   = glGetUniformLocation(p->cull, "u_planes");
+	p->u_cull_radius   = glGetUniformLocation(p->cull, "u_radius");
+	p->u_cull_count    = glGetUniformLocation(p->cull, "u_instance_count");
+	p->u_cull_enabled  = glGetUniformLocation(p->cull, "u_cull");
+
+	//Every font is a layer of the same texture array and every scene program samples unit 0 too
+	glProgramUniform1i(p->text, glGetUniformLocation(p->text, "u_atlas"), 0);
+	glProgramUniform1i(p->scene, glGetUniformLocation(p->scene, "u_texture"), 0);
+	glProgramUniform1i(p->instanced, glGetUniformLocation(p->instanced, "u_texture"), 0);
+	glProgramUniform1i(p->gpu, glGetUniformLocation(p->gpu, "u_texture"), 0);
+	return true;
+}
+
+//Draws a full region of a text stream, the text program and vertex array are already bound
+static void
+text_flush_stream(const stream_buffer* sb, const i32 count, void* user_data) {
+	const u32 vao = *(const u32*)user_data;
+
+	glVertexArrayVertexBuffer(vao, 0, sb->id, stream_buffer_offset(sb), sizeof(glyph_instance));
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+}
+
 int main(int argc, char* argv[]) {
+	//The number of cubes can be given as an argument, --text-bench times text layout once the fonts are loaded
+	i32 scene_cube_count = SCENE_DEFAULT_CUBES;
+	bool run_text_bench = false;
+	for(i32 i=1; i<argc; ++i) {
+		if(!strcmp(argv[i], "--text-bench")) {
+			run_text_bench = true;
+			continue;
+		}
+
+		scene_cube_count = atoi(argv[i]);
+		if(scene_cube_count < 1) {
+			printf("Invalid cube count, using %d\n", SCENE_DEFAULT_CUBES);
+			scene_cube_count = SCENE_DEFAULT_CUBES;
+		}
+	}
+
 	if(SDL_Init(SDL_INIT_VIDEO) != 0){
 		printf("SDL failed to initialize\n");
 		return 1;
@@ -214,141 +472,261 @@ int main(int argc, char* argv[]) {
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	const vertex_array text_vao  = vao_init();
-	const vertex_array scene_vao = vao_init();
-
-	shader_program_id text_program  = load_create_shader_program(TEXT_VERT_PATH, TEXT_FRAG_PATH);
-	shader_program_id scene_program = load_create_shader_program(SCENE_VERT_PATH, SCENE_FRAG_PATH);
-	if(!text_program || !scene_program) {
+	stream_vertex_array text_vao  = stream_vao_init(sizeof(glyph_instance) * HUD_MAX_GLYPHS);
+	stream_vertex_array scene_vao = stream_vao_init(sizeof(cube) * SCENE_CHUNK_CUBES);
+	const vertex_array instanced_vao = vao_init();
+
+	//Single cube index list shared by every cube, its size doesn't depend on the scene.
+	//It lives in the instanced vao's element buffer, the other vaos that draw whole cubes bind it too
+	const u32 cube_index_ebo = instanced_vao.ebo;
+	glNamedBufferStorage(cube_index_ebo, sizeof(cube_indices), cube_indices, 0);
+	i32*   shared_index_counts  = (i32*)malloc(sizeof(i32) * SCENE_CHUNK_CUBES);
+	void** shared_index_offsets = (void**)malloc(sizeof(void*) * SCENE_CHUNK_CUBES);
+	i32*   shared_base_vertices = (i32*)malloc(sizeof(i32) * SCENE_CHUNK_CUBES);
+	stream_buffer instance_stream = stream_buffer_init(sizeof(mat4) * SCENE_CHUNK_INSTANCES);
+
+	//Gpu driven scene buffers
+	u32 gpu_vao;
+	u32 gpu_instance_ssbo;
+	u32 gpu_visible_ssbo;
+	u32 gpu_command_buffer;
+	glCreateVertexArrays(1, &gpu_vao);
+	glCreateBuffers(1, &gpu_instance_ssbo);
+	glCreateBuffers(1, &gpu_visible_ssbo);
+	glCreateBuffers(1, &gpu_command_buffer);
+
+	const vertex_array voxel_vao = vao_init();
+	voxel_mesh voxel_scene_mesh = {};
+
+	shader_programs programs = {};
+	if(!shader_programs_create(&programs)) {
 		printf("Shader programs could not be created\n");
 		return 1;
 	}
 
-	const u32 u_text_proj = glGetUniformLocation(text_program, "u_proj");
-	const u32 u_proj_view  = glGetUniformLocation(scene_program, "u_proj_view");
-
-	quad quad_array[HUD_MAX_QUAD_COUNT];
-	cube cube_array[SCENE_MAX_CUBES];
-
-	//Text buffers
+	//Text buffers, one instance per glyph is written straight into the mapped stream regions.
+	//The quad corners come from gl_VertexID so there's no index buffer
 	{
-    	glBindVertexArray(text_vao.id);
-
-    	glBindBuffer(GL_ARRAY_BUFFER, text_vao.vbo);
-    	glBufferData(GL_ARRAY_BUFFER, sizeof(quad) * HUD_MAX_QUAD_COUNT, NULL, GL_DYNAMIC_DRAW);
+		glVertexArrayBindingDivisor(text_vao.id, 0, 1);
+
+		//Corner and size in quarter units
+		glVertexArrayAttribFormat(text_vao.id, 0, 2, GL_SHORT, GL_FALSE, offsetof(glyph_instance, pos));
+		glVertexArrayAttribBinding(text_vao.id, 0, 0);
+		glEnableVertexArrayAttrib(text_vao.id, 0);
+
+		glVertexArrayAttribFormat(text_vao.id, 1, 2, GL_UNSIGNED_SHORT, GL_FALSE, offsetof(glyph_instance, size));
+		glVertexArrayAttribBinding(text_vao.id, 1, 0);
+		glEnableVertexArrayAttrib(text_vao.id, 1);
+
+		//UV rect
+		glVertexArrayAttribFormat(text_vao.id, 2, 4, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(glyph_instance, uv));
+		glVertexArrayAttribBinding(text_vao.id, 2, 0);
+		glEnableVertexArrayAttrib(text_vao.id, 2);
+
+		glVertexArrayAttribFormat(text_vao.id, 3, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(glyph_instance, color));
+		glVertexArrayAttribBinding(text_vao.id, 3, 0);
+		glEnableVertexArrayAttrib(text_vao.id, 3);
+
+		//Atlas layer
+		glVertexArrayAttribIFormat(text_vao.id, 4, 1, GL_UNSIGNED_INT, offsetof(glyph_instance, layer));
+		glVertexArrayAttribBinding(text_vao.id, 4, 0);
+		glEnableVertexArrayAttrib(text_vao.id, 4);
+	}
 
-		u32 offset = 0;
-		u32 indices[HUD_MAX_INDEX_COUNT];
-		for(i32 i =0; i < HUD_MAX_INDEX_COUNT; i += 6) {
-			indices[i + 0] = 0 + offset;
-			indices[i + 1] = 1 + offset;
-			indices[i + 2] = 2 + offset;
+	{
+		//Every flush starts at the beginning of a region, so the indices only have to cover one chunk
+		cube_elements* elements_array = (cube_elements*)malloc(sizeof(cube_elements) * SCENE_CHUNK_CUBES);
+		for(i32 i=0; i<SCENE_CHUNK_CUBES; ++i) {
+			fill_cube_elements(elements_array[i], i);
+		}
 
-			indices[i + 3] = 2 + offset;
-			indices[i + 4] = 3 + offset;
-			indices[i + 5] = 0 + offset;
+		glNamedBufferData(scene_vao.ebo, sizeof(cube_elements) * SCENE_CHUNK_CUBES, elements_array, GL_STATIC_DRAW);
+		free(elements_array);
 
-			offset += 4;
+		//Per draw parameters of the shared index mode, all the draws of a chunk use the same index list
+		for(i32 i=0; i<SCENE_CHUNK_CUBES; ++i) {
+			shared_index_counts[i]   = 36;
+			shared_index_offsets[i]  = NULL;
+			shared_base_vertices[i]  = i * 24;
 		}
 
-    	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, text_vao.ebo);
-    	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-		//2D Positions
-	    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(hud_vertex), (void*)0);
-	    glEnableVertexAttribArray(0);
-	
-		//UVs
-	    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(hud_vertex), (void*)(2*sizeof(f32)));
-	    glEnableVertexAttribArray(1);
-	
-		//Atlas id
-	    glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(hud_vertex), (void*)(4*sizeof(f32)));
-	    glEnableVertexAttribArray(2);
-
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-	    glBindBuffer(GL_ARRAY_BUFFER, 0); 
-	    glBindVertexArray(0);
-		glUseProgram(0);
+		// positions and uvs
+		scene_vao_set_format(&scene_vao, false);
+		glVertexArrayAttribBinding(scene_vao.id, 0, 0);
+		glEnableVertexArrayAttrib(scene_vao.id, 0);
+		glVertexArrayAttribBinding(scene_vao.id, 1, 0);
+		glEnableVertexArrayAttrib(scene_vao.id, 1);
 	}
 
+	//Instanced scene buffers, the cube is uploaded only once and the model matrices are streamed
 	{
-		glBindVertexArray(scene_vao.id);
+		cube unit_cube;
+		make_cube(unit_cube);
 
-		glBindBuffer(GL_ARRAY_BUFFER, scene_vao.vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(cube_array), cube_array, GL_DYNAMIC_DRAW);
+		glNamedBufferData(instanced_vao.vbo, sizeof(unit_cube), unit_cube, GL_STATIC_DRAW);
+		glVertexArrayVertexBuffer(instanced_vao.id, 0, instanced_vao.vbo, 0, sizeof(scene_vertex));
+		glVertexArrayElementBuffer(instanced_vao.id, cube_index_ebo);
 
-		cube_elements elements_array[SCENE_MAX_CUBES];
-		for(i32 i; i<SCENE_MAX_CUBES; ++i) {
-			fill_cube_elements(elements_array[i], i);
+		// positions
+		glVertexArrayAttribFormat(instanced_vao.id, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(instanced_vao.id, 0, 0);
+		glEnableVertexArrayAttrib(instanced_vao.id, 0);
+
+		// uvs
+		glVertexArrayAttribFormat(instanced_vao.id, 1, 2, GL_FLOAT, GL_FALSE, offsetof(scene_vertex, v.uv));
+		glVertexArrayAttribBinding(instanced_vao.id, 1, 0);
+		glEnableVertexArrayAttrib(instanced_vao.id, 1);
+
+		// model matrices on binding 1, a mat4 attribute takes 4 locations
+		for(i32 i=0; i<4; ++i) {
+			glVertexArrayAttribFormat(instanced_vao.id, 2 + i, 4, GL_FLOAT, GL_FALSE, i * sizeof(vec4));
+			glVertexArrayAttribBinding(instanced_vao.id, 2 + i, 1);
+			glEnableVertexArrayAttrib(instanced_vao.id, 2 + i);
 		}
+		glVertexArrayBindingDivisor(instanced_vao.id, 1, 1);
+	}
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, scene_vao.ebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(elements_array), elements_array, GL_STATIC_DRAW);
+	//Gpu driven scene, shares the cube of the instanced scene and uploads the cube positions only once
+	{
+		glVertexArrayVertexBuffer(gpu_vao, 0, instanced_vao.vbo, 0, sizeof(scene_vertex));
+		glVertexArrayElementBuffer(gpu_vao, cube_index_ebo);
 
 		// positions
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(scene_vertex), (void*)0);
-		glEnableVertexAttribArray(0);
+		glVertexArrayAttribFormat(gpu_vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(gpu_vao, 0, 0);
+		glEnableVertexArrayAttrib(gpu_vao, 0);
 
 		// uvs
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(scene_vertex), (void*)offsetof(scene_vertex, v.uv));
-		glEnableVertexAttribArray(1);
+		glVertexArrayAttribFormat(gpu_vao, 1, 2, GL_FLOAT, GL_FALSE, offsetof(scene_vertex, v.uv));
+		glVertexArrayAttribBinding(gpu_vao, 1, 0);
+		glEnableVertexArrayAttrib(gpu_vao, 1);
+
+		vec4* instances = (vec4*)malloc(sizeof(vec4) * scene_cube_count);
+		for(i32 i=0; i<scene_cube_count; ++i) {
+			scene_cube_position(i, instances[i]);
+			instances[i][3] = (f32)i * 1.0f;
+		}
+		glNamedBufferStorage(gpu_instance_ssbo, sizeof(vec4) * scene_cube_count, instances, 0);
+		free(instances);
 
-		glBindVertexArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		glNamedBufferStorage(gpu_visible_ssbo, sizeof(u32) * scene_cube_count, NULL, 0);
+		glNamedBufferStorage(gpu_command_buffer, sizeof(draw_elements_command), NULL, GL_DYNAMIC_STORAGE_BIT);
 	}
 
-	//Font atlases setup here, can be expanded to include multiple fonts
+	//Voxel scene, cubes follow the layout of the other modes but touch each other
 	{
-		glUseProgram(text_program);
-		u32 u_atlases = glGetUniformLocation(text_program, "u_atlases");
-		i32 samplers[1] = { 0 };
-		glUniform1iv(u_atlases, 1, samplers);
-		glUseProgram(0);
-	}
+		const i32 layers = (scene_cube_count + 99) / 100;
+		voxel_volume volume = voxel_volume_init(10, layers, 10);
+		for(i32 i=0; i<scene_cube_count; ++i) {
+			*voxel_cell(&volume, i % 10, i / 100, (i % 100) / 10) = 1;
+		}
 
-	//Main Scene texture
-	{
-		glUseProgram(scene_program);
-		const u32 u_texture = glGetUniformLocation(scene_program, "u_texture");
-		glUniform1i(u_texture, 0);
-		glUseProgram(0);
+		const vec3 origin = { -50.5f, 1.0f, -0.5f };
+		voxel_mesh_build(&voxel_scene_mesh, &volume, origin);
+		voxel_volume_free(&volume);
+
+		glNamedBufferData(voxel_vao.vbo, sizeof(scene_vertex) * voxel_scene_mesh.vertex_count, voxel_scene_mesh.vertices, GL_STATIC_DRAW);
+		glNamedBufferData(voxel_vao.ebo, sizeof(u32) * voxel_scene_mesh.index_count, voxel_scene_mesh.indices, GL_STATIC_DRAW);
+		glVertexArrayVertexBuffer(voxel_vao.id, 0, voxel_vao.vbo, 0, sizeof(scene_vertex));
+		glVertexArrayElementBuffer(voxel_vao.id, voxel_vao.ebo);
+
+		// positions
+		glVertexArrayAttribFormat(voxel_vao.id, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribBinding(voxel_vao.id, 0, 0);
+		glEnableVertexArrayAttrib(voxel_vao.id, 0);
+
+		// uvs
+		glVertexArrayAttribFormat(voxel_vao.id, 1, 2, GL_FLOAT, GL_FALSE, offsetof(scene_vertex, v.uv));
+		glVertexArrayAttribBinding(voxel_vao.id, 1, 0);
+		glEnableVertexArrayAttrib(voxel_vao.id, 1);
+
+		printf("Voxel mesh: %d quads instead of %d cube faces\n", voxel_scene_mesh.quad_count, scene_cube_count * 6);
 	}
 
+	//Merged voxel faces have uvs past 1, so they need to repeat the texture
+	u32 repeat_sampler;
+	glCreateSamplers(1, &repeat_sampler);
+	glSamplerParameteri(repeat_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(repeat_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(repeat_sampler, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glSamplerParameteri(repeat_sampler, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
 	//Texture init
 	texture main_texture = load_texture("res/imgs/fsdlsfad[.png");
 
+	//Text layout picks its kernels from this too
+	bmath_init();
+
 	//Font init
+	font_registry fonts = font_registry_init(1024, 768, HUD_MAX_FONTS);
 	font main_font;
-	texture main_atlas;
+	font sdf_font;
+	bool sdf_text = false;
 	{
-		FILE* font_file = fopen("res/fonts/dogicapixel.ttf", "rb");
+		//Fonts only touch the tables they read, so the file is mapped instead of read in whole
+		file_mapping* font_file = file_map("res/fonts/dogicapixel.ttf", FILE_ACCESS_RANDOM);
 		if(!font_file) {
 			printf("Failed to load font file\n");
 		}
 
-		fseek(font_file, 0, SEEK_END);
-		long font_file_size = ftell(font_file);
-		rewind(font_file);
+		//Glyphs are added to the atlas as texts use them
+		main_font = create_font(&fonts, font_file, 64.0f);
 
-		u8* font_buffer = (u8*)malloc(font_file_size);
-		if(!font_buffer) {
-			printf("Failed\n");
-		}
+		//Same face as distances at half the size, both fonts share the mapping and hold a reference each
+		sdf_font = create_sdf_font(&fonts, font_file, 32.0f);
+		file_unmap(font_file);
 
-		size_t _ = fread(font_buffer, 1, font_file_size, font_file);
-		fclose(font_file);
+		//Later runs map whatever glyphs the last one used, the first run rasterizes them as texts need them
+		font_use_cache(&main_font, FONT_CACHE_DIR);
+		font_use_cache(&sdf_font, FONT_CACHE_DIR);
+	}
 
-		main_font = create_font(font_buffer, 1024, 768, 64.0f, 96);
-		main_atlas = create_font_atlas(main_font);
+	//Hud texts are retained, they're placed once the window size is known
+	text_batch hud = text_batch_init(HUD_MAX_GLYPHS, HUD_MAX_TEXTS);
+	f32 hud_w = 0.0f;
+	f32 hud_h = 0.0f;
+
+	const vec2 origin_pos = { 0.0f, 0.0f };
+	const text_handle fps_text = text_create(&hud, &main_font, origin_pos, "FPS:");
+	text_handle hud_rows[HUD_ROW_COUNT];
+	hud_rows[0] = text_create(&hud, &main_font, origin_pos, "Press f to disable/enable text");
+	hud_rows[1] = text_create(&hud, &main_font, origin_pos, "Press space to change mode, p for frame stats");
+	hud_rows[2] = text_create(&hud, &main_font, origin_pos, "Mode:");
+	hud_rows[3] = text_create(&hud, &main_font, origin_pos, "Vertices:");
+	hud_rows[4] = text_create(&hud, &main_font, origin_pos, "Visible:");
+	hud_rows[5] = text_create(&hud, &main_font, origin_pos, "Text upload:");
+	hud_rows[6] = text_create(&hud, &main_font, origin_pos, "Press l to show the console");
+
+	//The console has its own stream so the retained hud regions are left alone
+	stream_buffer console_stream = stream_buffer_init(sizeof(glyph_instance) * CONSOLE_STREAM_GLYPHS);
+	text_stream console = {};
+	bool draw_console = false;
+	i32 console_scroll = 0;  //First cube listed
+
+	stream_buffer perf_stream = stream_buffer_init(sizeof(glyph_instance) * PERF_STREAM_GLYPHS);
+	text_stream perf_text = {};
+	perf_stats perf;
+	bool draw_perf = false;
+
+	if(run_text_bench) {
+		text_bench(&main_font, 1.0f);
+		text_bench(&sdf_font, 1.5f);
 	}
 
-	events_data evs_data = { 0, 0, 0 };
+	job_pool pool;
+	job_pool_init(&pool, -1);
+	printf("Worker threads: %d\n", pool.thread_count);
+
+	events_data evs_data = { 0, 0, 0, 0 };
 	f64 dt               = 0.0;
 	f32 fps              = 0.0f;
 	f32 rot              = 0.0f;
 	bool draw_text       = true;
+	scene_mode mode      = SCENE_MODE_BATCHED;
+	bool packed_vertices = false;
+	bool cull_cubes      = true;
+	bool shared_indices  = false;
+	scene_batch batch    = {};
 	bool running         = true;
 
 	camera_data cam_data;
@@ -368,11 +746,13 @@ int main(int argc, char* argv[]) {
 
 	const u64 perf_frequency = SDL_GetPerformanceFrequency();
 	u64 last_counter = SDL_GetPerformanceCounter();
+	perf_init(&perf);
 
 	do {
 		SDL_Event event;
-		evs_data.xrel = 0;
-		evs_data.yrel = 0;
+		evs_data.xrel  = 0;
+		evs_data.yrel  = 0;
+		evs_data.wheel = 0;
 		while(SDL_PollEvent(&event))
 		{
 			evs_data = handle_events(&event, evs_data);
@@ -384,15 +764,10 @@ int main(int argc, char* argv[]) {
 		}
 
 		if(evs_data.requests & EVENT_HOT_RELOAD) {
-			shader_program_id temp_text_program_id;
-			shader_program_id temp_scene_program_id;
-
-			temp_text_program_id  = load_create_shader_program(TEXT_VERT_PATH, TEXT_FRAG_PATH);
-			temp_scene_program_id = load_create_shader_program(SCENE_VERT_PATH, SCENE_FRAG_PATH);
-
-			if(temp_text_program_id && temp_scene_program_id) {
-				text_program = temp_text_program_id;
-				scene_program = temp_scene_program_id;
+			shader_programs temp_programs = {};
+			if(shader_programs_create(&temp_programs)) {
+				shader_programs_destroy(&programs);
+				programs = temp_programs;
 				printf("Shaders reload sucessfully\n");
 			} else {
 				printf("Shaders could not be reloaded\n");
@@ -401,6 +776,64 @@ int main(int argc, char* argv[]) {
 			evs_data.requests &= ~EVENT_HOT_RELOAD;
 		}
 
+		if(evs_data.requests & EVENT_MODE_CHANGE) {
+			mode = (mode + 1) % SCENE_MODE_COUNT;
+			printf("Scene mode: %s\n", scene_mode_names[mode]);
+
+			evs_data.requests &= ~EVENT_MODE_CHANGE;
+		}
+
+		if(evs_data.requests & EVENT_MODE_VERTEX) {
+			packed_vertices = !packed_vertices;
+			scene_vao_set_format(&scene_vao, packed_vertices);
+			printf("Scene vertices: %s\n", packed_vertices ? "packed" : "float");
+
+			evs_data.requests &= ~EVENT_MODE_VERTEX;
+		}
+
+		if(evs_data.requests & EVENT_MODE_CULL) {
+			cull_cubes = !cull_cubes;
+			printf("Frustum culling: %s\n", cull_cubes ? "on" : "off");
+
+			evs_data.requests &= ~EVENT_MODE_CULL;
+		}
+
+		if(evs_data.requests & EVENT_MODE_INDEX) {
+			shared_indices = !shared_indices;
+			glVertexArrayElementBuffer(scene_vao.id, shared_indices ? cube_index_ebo : scene_vao.ebo);
+			printf("Scene indices: %s\n", shared_indices ? "shared" : "per cube");
+
+			evs_data.requests &= ~EVENT_MODE_INDEX;
+		}
+
+		if(evs_data.requests & EVENT_MODE_FONT) {
+			sdf_text = !sdf_text;
+
+			//Only the stats switch so both fonts are on screen, they're still drawn together.
+			//Texts keep the same on screen size, the sdf font is just scaled up
+			font* hud_font = sdf_text ? &sdf_font : &main_font;
+			const f32 hud_size = (f32)main_font.size / (f32)hud_font->size;
+			text_set_font(&hud, fps_text, hud_font, hud_size);
+			for(i32 i=2; i<HUD_ROW_COUNT; ++i) {
+				text_set_font(&hud, hud_rows[i], hud_font, hud_size);
+			}
+			printf("Hud font: %s\n", sdf_text ? "sdf" : "bitmap");
+
+			evs_data.requests &= ~EVENT_MODE_FONT;
+		}
+
+		if(evs_data.requests & EVENT_MODE_CONSOLE) {
+			draw_console = !draw_console;
+
+			evs_data.requests &= ~EVENT_MODE_CONSOLE;
+		}
+
+		if(evs_data.requests & EVENT_MODE_PERF) {
+			draw_perf = !draw_perf;
+
+			evs_data.requests &= ~EVENT_MODE_PERF;
+		}
+
 		if(evs_data.requests & EVENT_MODE_TEXT) {
 			draw_text = !draw_text;
 
@@ -461,6 +894,8 @@ int main(int argc, char* argv[]) {
 			vec3_copy(front, cam_data.front);
 		}
 
+		perf_mark(&perf, PERF_STAGE_EVENTS);
+
 		glClearColor(0.0f, 1.0f, 0.0f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -477,11 +912,6 @@ int main(int argc, char* argv[]) {
 
 			glEnable(GL_DEPTH_TEST);
 
-			//Bind everything needed
-        	glBindVertexArray(scene_vao.id);
-			glUseProgram(scene_program);
-			glBindTextureUnit(0, main_texture);
-
 			mat4_perspective(to_radians_32(45.0f), (f32)w / (f32)h, 0.1f, 1000.0f, scene_proj);
 
 			{
@@ -495,88 +925,229 @@ int main(int argc, char* argv[]) {
 			mat4 proj_view;
 			mat4_mul(scene_proj, view, proj_view);
 
-			const f32 x_begin = -50.0f;
-			      vec3 m_pos   = { x_begin, 0.0f, 0.0f };
-			const vec3 m_axis  = { 1.0f, 0.3f, 0.5f };
-			const vec3 m_scale = { 1.0f, 1.0f, 1.0f };
-			mat4 model;
+			vec4 planes[6];
+			mat4_frustum_planes(proj_view, planes);
+
+			scene_flush_context flush_ctx = {};
+			flush_ctx.pool            = &pool;
+			flush_ctx.job.rot         = rot;
+			flush_ctx.packed          = packed_vertices;
+			flush_ctx.scene_vao       = &scene_vao;
+			flush_ctx.u_origin        = programs.u_origin;
+			flush_ctx.u_extent        = programs.u_extent;
+			flush_ctx.shared_indices  = shared_indices;
+			flush_ctx.index_counts    = shared_index_counts;
+			flush_ctx.index_offsets   = (const void* const*)shared_index_offsets;
+			flush_ctx.base_vertices   = shared_base_vertices;
+			flush_ctx.instanced_vao   = instanced_vao.id;
+			flush_ctx.instance_stream = &instance_stream;
+			flush_ctx.perf            = &perf;
 
-			const u32 index_count = SCENE_MAX_CUBES * 36;
-			const f32 offset = 1.5f;
-			for(i32 i=0; i<SCENE_MAX_CUBES; ++i) {
-				mat4_identity(model);
+			glBindTextureUnit(0, main_texture);
 
-				m_pos[0] += offset;
+			//The gpu mode culls on the gpu and never fills the batch
+			batch.count = 0;
+			batch.flush_count = 0;
 
-				if(!(i % 10)) {
-					m_pos[2] += offset;
-					m_pos[0] = x_begin;
-				}
+			switch(mode)
+			{
+				case SCENE_MODE_BATCHED:
+				{
+					//Bind everything needed
+					glBindVertexArray(scene_vao.id);
+					glUseProgram(programs.scene);
+					glUniformMatrix4fv(programs.u_proj_view,  1, GL_FALSE, &proj_view[0][0]);
+					perf_mark(&perf, PERF_STAGE_DRAW);
+
+					scene_batch_begin(&batch, SCENE_CHUNK_CUBES, scene_flush_batched, &flush_ctx);
+					scene_batch_push_visible(&batch, scene_cube_count, cull_cubes ? planes : NULL);
+					scene_batch_end(&batch);
+					perf_count(&perf, batch.flush_count, batch.count * (packed_vertices ? sizeof(packed_cube) : sizeof(cube)));
+				} break;
 
-				if(!(i % 100)) {
-					m_pos[2] = 0.0f;
-					m_pos[0] = x_begin;
-					m_pos[1] += offset;
-				}
+				case SCENE_MODE_INSTANCED:
+				{
+					//Bind everything needed
+					glBindVertexArray(instanced_vao.id);
+					glUseProgram(programs.instanced);
+					glUniformMatrix4fv(programs.u_instanced_proj_view,  1, GL_FALSE, &proj_view[0][0]);
+					perf_mark(&perf, PERF_STAGE_DRAW);
+
+					scene_batch_begin(&batch, SCENE_CHUNK_INSTANCES, scene_flush_instanced, &flush_ctx);
+					scene_batch_push_visible(&batch, scene_cube_count, cull_cubes ? planes : NULL);
+					scene_batch_end(&batch);
+					perf_count(&perf, batch.flush_count, batch.count * sizeof(mat4));
+				} break;
 
-				const f32 rot_offset = (f32)i * 1.0f;
-				mat4_translate(model, m_pos);
-				mat4_scale(model, m_scale);
-				mat4_rotate(model, to_radians_32(rot + rot_offset), m_axis);
+				case SCENE_MODE_GPU:
+				{
+					const draw_elements_command command = { 36, 0, 0, 0, 0 };
+
+					glNamedBufferSubData(gpu_command_buffer, 0, sizeof(command), &command);
+					glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, gpu_instance_ssbo);
+					glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, gpu_visible_ssbo);
+					glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, gpu_command_buffer);
+
+					//Cull and append the visible cubes to the draw command
+					glUseProgram(programs.cull);
+					glUniform4fv(programs.u_cull_planes, 6, &planes[0][0]);
+					glUniform1f(programs.u_cull_radius, SCENE_CUBE_RADIUS);
+					glUniform1ui(programs.u_cull_count, scene_cube_count);
+					glUniform1i(programs.u_cull_enabled, cull_cubes);
+					//A dimension holds at most 65535 groups, bigger scenes go on to more rows of groups
+					const i32 cull_groups   = (scene_cube_count + 63) / 64;
+					const i32 cull_groups_x = cull_groups < 65535 ? cull_groups : 65535;
+					glDispatchCompute(cull_groups_x, (cull_groups + cull_groups_x - 1) / cull_groups_x, 1);
+					glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+					//Bind everything needed
+					glBindVertexArray(gpu_vao);
+					glUseProgram(programs.gpu);
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gpu_command_buffer);
+
+					glUniformMatrix4fv(programs.u_gpu_proj_view, 1, GL_FALSE, &proj_view[0][0]);
+					glUniform1f(programs.u_gpu_rot, rot);
+
+					glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, 0, 1, 0);
+					glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+					perf_count(&perf, 1, sizeof(command));
+				} break;
 
-				make_cube(cube_array[i]);
-				transform_cube(cube_array[i], model);
-			}
-			rot+=dt * 0.1f;
+				case SCENE_MODE_VOXEL:
+				{
+					const vec3 origin = { 0.0f, 0.0f, 0.0f };
+					const vec3 extent = { 1.0f, 1.0f, 1.0f };
 
+					//Bind everything needed
+					glBindVertexArray(voxel_vao.id);
+					glUseProgram(programs.scene);
+					glBindSampler(0, repeat_sampler);
 
-			glBindBuffer(GL_ARRAY_BUFFER, scene_vao.vbo);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(cube_array), cube_array);
+					glUniformMatrix4fv(programs.u_proj_view,  1, GL_FALSE, &proj_view[0][0]);
+					glUniform3fv(programs.u_origin, 1, origin);
+					glUniform3fv(programs.u_extent, 1, extent);
 
-			glUniformMatrix4fv(u_proj_view,  1, GL_FALSE, &proj_view[0][0]);
+					glDrawElements(GL_TRIANGLES, voxel_scene_mesh.index_count, GL_UNSIGNED_INT, 0);
+					glBindSampler(0, 0);
+					perf_count(&perf, 1, 0);
+				} break;
 
-			glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
+				default: break;
+			}
+			rot+=dt * 0.1f;
 		}
+		perf_mark(&perf, PERF_STAGE_DRAW);
 
-		if(draw_text) {
-			u32 index_count = 0;
+		//The hud and the perf overlay share the text program and vertex array
+		if(draw_text || draw_perf) {
 			mat4 hud_proj;
 
 			//Bind everything needed
         	glBindVertexArray(text_vao.id);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, text_vao.ebo);
-			glUseProgram(text_program);
-			glBindTextureUnit(0, main_atlas);
+			glUseProgram(programs.text);
+			glBindTextureUnit(0, fonts.atlas);
 
 			//Enabling depth_test will break the exclusive 2D rendering
 			glDisable(GL_DEPTH_TEST);
 
 			//!no uniform needs to be get every frame it was done this way for simplicity and it's not optimal
 			mat4_ortho(-w, w, -h, h, -1.0f, 1.0f, hud_proj);
-			glUniformMatrix4fv(u_text_proj, 1, GL_FALSE, &hud_proj[0][0]);
+			glUniformMatrix4fv(programs.u_text_proj, 1, GL_FALSE, &hud_proj[0][0]);
+			glUniform1ui(programs.u_text_sdf_layers, fonts.sdf_layers);
+			glUniform1ui(programs.u_text_solid_layer, TEXT_SOLID_LAYER);
+			glUniform1f(programs.u_text_sdf_edge, FONT_SDF_ON_EDGE / 255.0f);
+		}
 
-			//Create text on screen
-			{ 
-				vec2 txt_pos = { -w, -h + 100.0f };
-				i32 current_vertice = 0;
+		if(draw_text) {
+			//Update text on screen, texts that didn't change are not laid out again
+			{
+				if(w != hud_w || h != hud_h) {
+					//The fps sits in the bottom right corner, its box spans the whole window
+					vec2 txt_pos = { -w, -h + 100.0f };
+					text_set_pos(&hud, fps_text, txt_pos);
+					text_set_box(&hud, fps_text, 2.0f * w, TEXT_ALIGN_RIGHT);
+
+					for(i32 i=0; i<HUD_ROW_COUNT; ++i) {
+						txt_pos[0] = -w; txt_pos[1] = h - 16.0f - 100.0f * (f32)i;
+						text_set_pos(&hud, hud_rows[i], txt_pos);
+					}
 
-				make_text_row(main_font, txt_pos, &current_vertice, &index_count, quad_array, "FPS:%.f", fps);
+					hud_w = w;
+					hud_h = h;
+				}
+
+				//Same colors as the bars of the frame stats, only laid out again when the band changes
+				const u8 fps_good[4] = { 80, 220, 80, 255 };
+				const u8 fps_slow[4] = { 240, 200, 60, 255 };
+				const u8 fps_bad[4]  = { 240, 70, 60, 255 };
+				text_set(&hud, fps_text, "FPS:%.f", fps);
+				text_set_color(&hud, fps_text, fps >= 60.0 ? fps_good : (fps >= 30.0 ? fps_slow : fps_bad));
+				text_set(&hud, hud_rows[2], "Mode:%s", scene_mode_names[mode]);
+				text_set(&hud, hud_rows[3], "Vertices:%s Indices:%s", packed_vertices ? "packed" : "float", shared_indices ? "shared" : "per cube");
+				if(mode == SCENE_MODE_GPU) {
+					text_set(&hud, hud_rows[4], "Visible:culled on gpu");
+				} else if(mode == SCENE_MODE_VOXEL) {
+					text_set(&hud, hud_rows[4], "Quads:%d/%d", voxel_scene_mesh.quad_count, scene_cube_count * 6);
+				} else {
+					text_set(&hud, hud_rows[4], "Visible:%d/%d Flushes:%u", batch.count, scene_cube_count, batch.flush_count);
+				}
+				text_set(&hud, hud_rows[5], "Text upload:%u bytes Font:%s", hud.uploaded_bytes, sdf_text ? "sdf" : "bitmap");
+				if(draw_console) {
+					text_set(&hud, hud_rows[6], "Console:%u glyphs Flushes:%u, scroll with the wheel", console.total, console.flush_count);
+				} else {
+					text_set(&hud, hud_rows[6], "Press l to show the console");
+				}
+			}
 
-				txt_pos[0] = -w; txt_pos[1] = h - 16.0f;
-				make_text_row(main_font, txt_pos, &current_vertice, &index_count, quad_array, "Press f to disable/enable text");
-				txt_pos[0] = -w; txt_pos[1] = h - 116.0f;
-				make_text_row(main_font, txt_pos, &current_vertice, &index_count, quad_array, "Press space to change mode");
+			/*
+			  Lists the position of every cube, only the lines that fit under the top of the window are laid out
+			  and the wheel scrolls through the rest. A full screen can still take more glyphs than a region holds
+			*/
+			if(draw_console) {
+				const u8 console_color[4] = { 140, 255, 140, 255 };
+				vec2 line_pos = { 0.0f, -h + 200.0f };
+
+				const f32 line_h = main_font.line_height * CONSOLE_TEXT_SIZE;
+				const i32 lines  = (i32)((h - line_pos[1]) / line_h) - 1;
+				const i32 max_scroll = scene_cube_count > lines ? scene_cube_count - lines : 0;
+				console_scroll -= evs_data.wheel * CONSOLE_SCROLL_LINES;
+				console_scroll  = console_scroll < 0 ? 0 : (console_scroll > max_scroll ? max_scroll : console_scroll);
+				const i32 last  = console_scroll + lines < scene_cube_count ? console_scroll + lines : scene_cube_count;
+
+				text_stream_begin(&console, &console_stream, text_flush_stream, (void*)&text_vao.id);
+				for(i32 i=console_scroll; i<last; ++i) {
+					vec3 p;
+					scene_cube_position(i, p);
+					text_stream_print(&console, &main_font, line_pos, CONSOLE_TEXT_SIZE, console_color, "cube %d: %.2f %.2f %.2f", i, p[0], p[1], p[2]);
+				}
+				text_stream_end(&console);
+				perf_count(&perf, console.flush_count, console.total * sizeof(glyph_instance));
 			}
 
+			//Only the glyphs that changed since this region was last used are copied
+			glyph_instance* glyph_array = (glyph_instance*)stream_buffer_begin(&text_vao.vbo);
+			const i32 hud_glyphs = text_batch_upload(&hud, glyph_array, text_vao.vbo.region);
+			stream_vao_bind_region(&text_vao, sizeof(glyph_instance));
+			perf_mark(&perf, PERF_STAGE_UPLOAD);
 
-			//Update data on gpu
-			glBindBuffer(GL_ARRAY_BUFFER, text_vao.vbo);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(quad_array), quad_array);
+        	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, hud_glyphs);
+			stream_buffer_end(&text_vao.vbo);
+			perf_count(&perf, 1, hud.uploaded_bytes);
+			perf_mark(&perf, PERF_STAGE_DRAW);
+		}
 
-        	glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
+		//Built from scratch every frame, it's a few hundred quads so it stays on a single flush
+		if(draw_perf) {
+			text_stream_begin(&perf_text, &perf_stream, text_flush_stream, (void*)&text_vao.id);
+			perf_draw(&perf, &perf_text, &main_font, -w + 16.0f, h - 16.0f);
+			text_stream_end(&perf_text);
+			perf_count(&perf, perf_text.flush_count, perf_text.total * sizeof(glyph_instance));
+			perf_mark(&perf, PERF_STAGE_UPLOAD);
 		}
 
 		SDL_GL_SwapWindow(window);
+		perf_mark(&perf, PERF_STAGE_SWAP);
+		perf_end_frame(&perf);
 
 		//Performance monitoring
 		const u64 end_counter = SDL_GetPerformanceCounter();
@@ -588,13 +1159,36 @@ int main(int argc, char* argv[]) {
 		last_counter = end_counter;
 	} while(running);
 
+	job_pool_destroy(&pool);
+	scene_batch_free(&batch);
+	text_destroy(&hud, fps_text);
+	for(i32 i=0; i<HUD_ROW_COUNT; ++i) {
+		text_destroy(&hud, hud_rows[i]);
+	}
+	text_batch_free(&hud);
+	stream_buffer_delete(&console_stream);
+	stream_buffer_delete(&perf_stream);
+	font_update_cache(&main_font);
+	font_update_cache(&sdf_font);
 	free_font(&main_font);
-	vao_delete(text_vao);
-	vao_delete(scene_vao);
-	glDeleteTextures(1, &main_atlas);
+	free_font(&sdf_font);
+	font_registry_free(&fonts);
+	stream_vao_delete(&text_vao);
+	stream_vao_delete(&scene_vao);
+	vao_delete(instanced_vao);
+	vao_delete(voxel_vao);
+	voxel_mesh_free(&voxel_scene_mesh);
+	glDeleteSamplers(1, &repeat_sampler);
+	free(shared_index_counts);
+	free(shared_index_offsets);
+	free(shared_base_vertices);
+	stream_buffer_delete(&instance_stream);
+	glDeleteVertexArrays(1, &gpu_vao);
+	glDeleteBuffers(1, &gpu_instance_ssbo);
+	glDeleteBuffers(1, &gpu_visible_ssbo);
+	glDeleteBuffers(1, &gpu_command_buffer);
 	glDeleteTextures(1, &main_texture);
-    glDeleteProgram(text_program);
-    glDeleteProgram(scene_program);
+    shader_programs_destroy(&programs);
 
 	SDL_DestroyWindow(window);
 	SDL_Quit();
@@ -14,6 +14,7 @@ to_radians_32(const f32 deg) { return deg * PI32 / 180.0f; }
 typedef f32 vec2[2];
 typedef f32 vec3[3];
 typedef f32 vec4[4];
+typedef f32 quat[4]; //x, y, z, w
 
 typedef f32 mat3[3][3];
 typedef f32 mat4[4][4];
@@ -27,6 +28,8 @@ typedef f32 mat4[4][4];
                        {0.0f, 0.0f, 1.0f, 0.0f},                    \
                        {0.0f, 0.0f, 0.0f, 1.0f}}
 
+#define QUAT_IDENTITY {0.0f, 0.0f, 0.0f, 1.0f}
+
 /*Vec2 Area*/
 BATCH_INLINE void
 vec2_copy(const vec2 a, vec2 dest) {
@@ -151,6 +154,140 @@ vec4_scale(const vec4 v, const f32 s, vec4 dest) {
 	dest[3] = v[3] * s;
 }
 
+/*Quat Area*/
+
+/*
+  Rotations as unit quaternions, q * v * conjugate(q) rotates v.
+  Products read right to left like matrices, quat_mul(a, b) rotates by b and then by a
+*/
+BATCH_INLINE void
+quat_identity(quat dest) {
+	dest[0] = 0.0f;
+	dest[1] = 0.0f;
+	dest[2] = 0.0f;
+	dest[3] = 1.0f;
+}
+
+//Same rotation as mat4_rotate_make, axis doesn't have to be normalized
+BATCH_INLINE void
+quat_from_axis_angle(const vec3 axis, const f32 angle, quat dest) {
+	vec3 a;
+	vec3_normalize_to(axis, a);
+
+	const f32 s = sinf(angle * 0.5f);
+	dest[0] = a[0] * s;
+	dest[1] = a[1] * s;
+	dest[2] = a[2] * s;
+	dest[3] = cosf(angle * 0.5f);
+}
+
+BATCH_INLINE f32
+quat_dot(const quat a, const quat b) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3];
+}
+
+BATCH_INLINE void
+quat_normalize(quat q) {
+	const f32 norm = sqrtf(quat_dot(q, q));
+
+	if(norm == 0.0f) {
+		quat_identity(q);
+		return;
+	}
+
+	vec4_scale(q, 1.0f / norm, q);
+}
+
+BATCH_INLINE void
+quat_conjugate(const quat q, quat dest) {
+	dest[0] = -q[0];
+	dest[1] = -q[1];
+	dest[2] = -q[2];
+	dest[3] =  q[3];
+}
+
+//dest can be a or b
+BATCH_INLINE void
+quat_mul(const quat a, const quat b, quat dest) {
+	const f32 x = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+	const f32 y = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+	const f32 z = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+	const f32 w = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+
+	dest[0] = x;
+	dest[1] = y;
+	dest[2] = z;
+	dest[3] = w;
+}
+
+BATCH_INLINE void
+quat_rotatev3(const quat q, const vec3 v, vec3 dest) {
+	//v + w * t + cross(q, t) with t = 2 * cross(q, v)
+	const vec3 u = { q[0], q[1], q[2] };
+	vec3 t, c;
+	vec3_cross(u, v, t);
+	vec3_scale(t, 2.0f, t);
+	vec3_cross(u, t, c);
+
+	dest[0] = v[0] + q[3] * t[0] + c[0];
+	dest[1] = v[1] + q[3] * t[1] + c[1];
+	dest[2] = v[2] + q[3] * t[2] + c[2];
+}
+
+/*
+  Normalized linear interpolation, takes the short way around.
+  The speed isn't constant along the arc but it's cheap and close to slerp for the small steps of a frame
+*/
+BATCH_INLINE void
+quat_nlerp(const quat a, const quat b, const f32 t, quat dest) {
+	const f32 tb = quat_dot(a, b) < 0.0f ? -t : t;
+	const f32 ta = 1.0f - t;
+
+	dest[0] = a[0] * ta + b[0] * tb;
+	dest[1] = a[1] * ta + b[1] * tb;
+	dest[2] = a[2] * ta + b[2] * tb;
+	dest[3] = a[3] * ta + b[3] * tb;
+	quat_normalize(dest);
+}
+
+//Constant speed along the shortest arc, falls back to nlerp when a and b are too close for the angle to be accurate
+BATCH_INLINE void
+quat_slerp(const quat a, const quat b, const f32 t, quat dest) {
+	f32 cos_theta = quat_dot(a, b);
+	f32 sign = 1.0f;
+	if(cos_theta < 0.0f) {
+		cos_theta = -cos_theta;
+		sign = -1.0f;
+	}
+
+	if(cos_theta > 0.9995f) {
+		quat_nlerp(a, b, t, dest);
+		return;
+	}
+
+	const f32 theta     = acosf(cos_theta);
+	const f32 inv_sin   = 1.0f / sinf(theta);
+	const f32 ta        = sinf((1.0f - t) * theta) * inv_sin;
+	const f32 tb        = sinf(t * theta) * inv_sin * sign;
+
+	dest[0] = a[0] * ta + b[0] * tb;
+	dest[1] = a[1] * ta + b[1] * tb;
+	dest[2] = a[2] * ta + b[2] * tb;
+	dest[3] = a[3] * ta + b[3] * tb;
+}
+
+/*
+  Position, rotation and scale of an object in 10 floats instead of the 16 of its matrix.
+  Animating one is just moving, slerping and scaling its parts, the matrix is only built for drawing
+*/
+typedef struct {
+	vec3 pos;
+	quat rot;
+	vec3 scale;
+} transform;
+
+#define TRANSFORM_IDENTITY {{0.0f, 0.0f, 0.0f}, QUAT_IDENTITY, {1.0f, 1.0f, 1.0f}}
+
 /*Mat3 Area*/
 
 BATCH_INLINE void
@@ -210,46 +347,37 @@ mat4_copy(const mat4 mat, mat4 dest) {
 	dest[2][3] = mat[2][3];  dest[3][3] = mat[3][3];
 }
 
+//a * b + c, a single fused instruction only when the whole program is built with fma,
+//kernels that check the cpu at runtime use _mm_fmadd_ps directly instead
 BATCH_INLINE __m128
 mm_fmadd(__m128 a, __m128 b, __m128 c) {
-  return _mm_add_ps(c, _mm_mul_ps(a, b));
+#if defined(__FMA__)
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(c, _mm_mul_ps(a, b));
+#endif
 }
 
-BATCH_INLINE void
-mat4_mulv4(const mat4 m, const vec4 v, vec4 dest) {
-	#if 0
+/*
+  The matrix products come in scalar and avx/fma versions, bmath_init points these at the avx ones when the cpu has them.
+  Without avx the scalar ones are used, at -O2 the compiler vectorizes them as well as hand written sse does.
+  Matrices don't have to be aligned and dest can be any of the inputs
+*/
+typedef void (*mat4_mulv4_func)(const mat4 m, const vec4 v, vec4 dest);
+typedef void (*mat4_mul_func)(const mat4 m1, const mat4 m2, mat4 dest);
+
+static void
+mat4_mulv4_scalar(const mat4 m, const vec4 v, vec4 dest) {
 	vec4 res;
 	res[0] = m[0][0] * v[0] + m[1][0] * v[1] + m[2][0] * v[2] + m[3][0] * v[3];
 	res[1] = m[0][1] * v[0] + m[1][1] * v[1] + m[2][1] * v[2] + m[3][1] * v[3];
 	res[2] = m[0][2] * v[0] + m[1][2] * v[1] + m[2][2] * v[2] + m[3][2] * v[3];
 	res[3] = m[0][3] * v[0] + m[1][3] * v[1] + m[2][3] * v[2] + m[3][3] * v[3];
 	vec4_copy(res, dest);
-	#else
-
-	__m128 x0, x1, m0, m1, m2, m3, v0, v1, v2, v3;
-
-	m0 = _mm_load_ps(m[0]);
-	m1 = _mm_load_ps(m[1]);
-	m2 = _mm_load_ps(m[2]);
-	m3 = _mm_load_ps(m[3]);
-
-	x0 = _mm_load_ps(v);
-
-	v0 = _mm_set_ps1(v[0]);
-	v1 = _mm_set_ps1(v[1]);
-	v2 = _mm_set_ps1(v[2]);
-	v3 = _mm_set_ps1(v[3]);
-
-	x1 = _mm_mul_ps(m3, v3);
-	x1 = mm_fmadd(m2, v2, x1);
-	x1 = mm_fmadd(m1, v1, x1);
-	x1 = mm_fmadd(m0, v0, x1);
-
-	_mm_store_ps(dest, x1);
-
-	#endif
 }
 
+static mat4_mulv4_func mat4_mulv4 = mat4_mulv4_scalar;
+
 BATCH_INLINE void
 mat4_mulv3(const mat4 m, const f32 last, const vec3 v, vec3 dest) {
 	#if 1
@@ -310,8 +438,8 @@ mat4_rotate_make(mat4 m, const f32 angle, const vec3 axis) {
 	m[3][3] = 1.0f;
 }
 
-BATCH_INLINE void
-mat4_mul(const mat4 m1, const mat4 m2, mat4 dest) {
+static void
+mat4_mul_scalar(const mat4 m1, const mat4 m2, mat4 dest) {
 	const f32 a00 = m1[0][0], a01 = m1[0][1], a02 = m1[0][2], a03 = m1[0][3],
 	          a10 = m1[1][0], a11 = m1[1][1], a12 = m1[1][2], a13 = m1[1][3],
 	          a20 = m1[2][0], a21 = m1[2][1], a22 = m1[2][2], a23 = m1[2][3],
@@ -340,8 +468,8 @@ mat4_mul(const mat4 m1, const mat4 m2, mat4 dest) {
 	dest[3][3] = a03 * b30 + a13 * b31 + a23 * b32 + a33 * b33;
 }
 
-BATCH_INLINE void
-mat4_mul_rot(const mat4 m1, const mat4 m2, mat4 dest) {
+static void
+mat4_mul_rot_scalar(const mat4 m1, const mat4 m2, mat4 dest) {
 	const f32 a00 = m1[0][0], a01 = m1[0][1], a02 = m1[0][2], a03 = m1[0][3],
               a10 = m1[1][0], a11 = m1[1][1], a12 = m1[1][2], a13 = m1[1][3],
               a20 = m1[2][0], a21 = m1[2][1], a22 = m1[2][2], a23 = m1[2][3],
@@ -372,6 +500,9 @@ mat4_mul_rot(const mat4 m1, const mat4 m2, mat4 dest) {
  	dest[3][3] = a33;
 }
 
+static mat4_mul_func mat4_mul     = mat4_mul_scalar;
+static mat4_mul_func mat4_mul_rot = mat4_mul_rot_scalar;
+
 BATCH_INLINE void
 mat4_rotate(mat4 m, const f32 angle, const vec3 axis) {
 	mat4 rot;
@@ -393,6 +524,78 @@ mat4_scale(mat4 m, const vec3 v) {
 	mat4_scale_to(m, v, m);
 }
 
+/*
+  Builds translate(t) * rotation * scale(s) straight into dest, one pass with no intermediate matrices or products.
+  Scale is applied first, with a uniform scale that's the same matrix the identity, translate, scale, rotate chain makes.
+  The rotation is around axis, which doesn't have to be normalized, by angle in radians
+*/
+BATCH_INLINE void
+mat4_compose_axis_angle(const vec3 t, const vec3 axis, const f32 angle, const vec3 s, mat4 dest) {
+	vec3 a;
+	vec3_normalize_to(axis, a);
+
+	const f32 c  = cosf(angle);
+	const f32 sn = sinf(angle);
+	const f32 t1 = 1.0f - c;
+
+	const f32 xy = t1 * a[0] * a[1], xz = t1 * a[0] * a[2], yz = t1 * a[1] * a[2];
+	const f32 sx = sn * a[0], sy = sn * a[1], sz = sn * a[2];
+
+	dest[0][0] = (t1 * a[0] * a[0] + c) * s[0];
+	dest[0][1] = (xy + sz) * s[0];
+	dest[0][2] = (xz - sy) * s[0];
+	dest[0][3] = 0.0f;
+
+	dest[1][0] = (xy - sz) * s[1];
+	dest[1][1] = (t1 * a[1] * a[1] + c) * s[1];
+	dest[1][2] = (yz + sx) * s[1];
+	dest[1][3] = 0.0f;
+
+	dest[2][0] = (xz + sy) * s[2];
+	dest[2][1] = (yz - sx) * s[2];
+	dest[2][2] = (t1 * a[2] * a[2] + c) * s[2];
+	dest[2][3] = 0.0f;
+
+	dest[3][0] = t[0];
+	dest[3][1] = t[1];
+	dest[3][2] = t[2];
+	dest[3][3] = 1.0f;
+}
+
+//Same with the rotation given as a unit quaternion
+BATCH_INLINE void
+mat4_compose_quat(const vec3 t, const quat q, const vec3 s, mat4 dest) {
+	const f32 x2 = q[0] + q[0], y2 = q[1] + q[1], z2 = q[2] + q[2];
+	const f32 xx = q[0] * x2, yy = q[1] * y2, zz = q[2] * z2;
+	const f32 xy = q[0] * y2, xz = q[0] * z2, yz = q[1] * z2;
+	const f32 wx = q[3] * x2, wy = q[3] * y2, wz = q[3] * z2;
+
+	dest[0][0] = (1.0f - yy - zz) * s[0];
+	dest[0][1] = (xy + wz) * s[0];
+	dest[0][2] = (xz - wy) * s[0];
+	dest[0][3] = 0.0f;
+
+	dest[1][0] = (xy - wz) * s[1];
+	dest[1][1] = (1.0f - xx - zz) * s[1];
+	dest[1][2] = (yz + wx) * s[1];
+	dest[1][3] = 0.0f;
+
+	dest[2][0] = (xz + wy) * s[2];
+	dest[2][1] = (yz - wx) * s[2];
+	dest[2][2] = (1.0f - xx - yy) * s[2];
+	dest[2][3] = 0.0f;
+
+	dest[3][0] = t[0];
+	dest[3][1] = t[1];
+	dest[3][2] = t[2];
+	dest[3][3] = 1.0f;
+}
+
+BATCH_INLINE void
+transform_to_mat4(const transform* t, mat4 dest) {
+	mat4_compose_quat(t->pos, t->rot, t->scale, dest);
+}
+
 BATCH_INLINE void
 mat4_ortho(const f32 left,   const f32 right,
            const f32 bottom, const f32 top,
@@ -456,4 +659,567 @@ mat4_look_at(const vec3 eye, const vec3 center, const vec3 up, mat4 dest) {
 	dest[3][3] = 1.0f;
 }
 
+/*Frustum Area*/
+
+/*
+  Extracts the 6 planes of the clip volume of m (projection * view) as ax + by + cz + d, normals point inside
+  Order is left, right, bottom, top, near, far
+*/
+BATCH_INLINE void
+mat4_frustum_planes(const mat4 m, vec4 dest[6]) {
+	for(i32 i=0; i<3; ++i) {
+		for(i32 c=0; c<4; ++c) {
+			dest[i * 2 + 0][c] = m[c][3] + m[c][i];
+			dest[i * 2 + 1][c] = m[c][3] - m[c][i];
+		}
+	}
+
+	for(i32 i=0; i<6; ++i) {
+		const f32 norm = sqrtf(dest[i][0] * dest[i][0] + dest[i][1] * dest[i][1] + dest[i][2] * dest[i][2]);
+		if(norm > 0.0f) {
+			vec4_scale(dest[i], 1.0f / norm, dest[i]);
+		}
+	}
+}
+
+//True if the sphere touches the inside of the frustum, planes must come from mat4_frustum_planes
+BATCH_INLINE bool
+frustum_test_sphere(const vec4 planes[6], const vec3 center, const f32 radius) {
+	for(i32 i=0; i<6; ++i) {
+		if(vec3_dot(planes[i], center) + planes[i][3] < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*Batch Area*/
+
+/*
+  Functions compiled for instruction sets that are only used after checking the cpu at runtime.
+  There's a single wide tier, the avx kernels all need avx2 and fma, cpus with only avx use the sse or scalar ones
+*/
+#define BMATH_TARGET_AVX2 __attribute__((target("avx2,fma")))
+
+//Every kernel built with BMATH_TARGET_AVX2 has to check avx2_fma, avx2 alone doesn't mean fma is there
+typedef struct {
+	bool avx2_fma;
+} bmath_cpu_features;
+
+static bmath_cpu_features bmath_cpu;
+
+//Writes 4 transformed points held in x, y and z lanes into interleaved xyz destinations
+BATCH_INLINE void
+mm_store_points4(__m128 x, __m128 y, __m128 z, f32* dest, const i32 stride) {
+	__m128 w = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+
+	_mm_storel_pi((__m64*)(dest + 0 * stride), x);
+	_mm_store_ss(dest + 0 * stride + 2, _mm_movehl_ps(x, x));
+	_mm_storel_pi((__m64*)(dest + 1 * stride), y);
+	_mm_store_ss(dest + 1 * stride + 2, _mm_movehl_ps(y, y));
+	_mm_storel_pi((__m64*)(dest + 2 * stride), z);
+	_mm_store_ss(dest + 2 * stride + 2, _mm_movehl_ps(z, z));
+	_mm_storel_pi((__m64*)(dest + 3 * stride), w);
+	_mm_store_ss(dest + 3 * stride + 2, _mm_movehl_ps(w, w));
+}
+
+/*
+  Transforms count points given in structure of arrays form by m, with w = 1
+  dest is interleaved, every point is written as 3 floats and stride is the distance between points in floats
+*/
+typedef void (*mat4_transform_points_func)(const mat4 m,
+                                           const f32* xs, const f32* ys, const f32* zs,
+                                           const i32 count,
+                                           f32* dest, const i32 stride);
+
+static void
+mat4_transform_points_scalar(const mat4 m,
+                             const f32* xs, const f32* ys, const f32* zs,
+                             const i32 count,
+                             f32* dest, const i32 stride) {
+	for(i32 i=0; i<count; ++i) {
+		const f32 x = xs[i], y = ys[i], z = zs[i];
+		f32* d = dest + i * stride;
+		d[0] = m[0][0] * x + m[1][0] * y + m[2][0] * z + m[3][0];
+		d[1] = m[0][1] * x + m[1][1] * y + m[2][1] * z + m[3][1];
+		d[2] = m[0][2] * x + m[1][2] * y + m[2][2] * z + m[3][2];
+	}
+}
+
+static void
+mat4_transform_points_sse(const mat4 m,
+                          const f32* xs, const f32* ys, const f32* zs,
+                          const i32 count,
+                          f32* dest, const i32 stride) {
+	const __m128 m00 = _mm_set_ps1(m[0][0]), m01 = _mm_set_ps1(m[0][1]), m02 = _mm_set_ps1(m[0][2]),
+	             m10 = _mm_set_ps1(m[1][0]), m11 = _mm_set_ps1(m[1][1]), m12 = _mm_set_ps1(m[1][2]),
+	             m20 = _mm_set_ps1(m[2][0]), m21 = _mm_set_ps1(m[2][1]), m22 = _mm_set_ps1(m[2][2]),
+	             m30 = _mm_set_ps1(m[3][0]), m31 = _mm_set_ps1(m[3][1]), m32 = _mm_set_ps1(m[3][2]);
+
+	i32 i = 0;
+	for(; i + 4 <= count; i += 4) {
+		const __m128 x = _mm_loadu_ps(xs + i);
+		const __m128 y = _mm_loadu_ps(ys + i);
+		const __m128 z = _mm_loadu_ps(zs + i);
+
+		const __m128 rx = mm_fmadd(m00, x, mm_fmadd(m10, y, mm_fmadd(m20, z, m30)));
+		const __m128 ry = mm_fmadd(m01, x, mm_fmadd(m11, y, mm_fmadd(m21, z, m31)));
+		const __m128 rz = mm_fmadd(m02, x, mm_fmadd(m12, y, mm_fmadd(m22, z, m32)));
+
+		mm_store_points4(rx, ry, rz, dest + i * stride, stride);
+	}
+
+	mat4_transform_points_scalar(m, xs + i, ys + i, zs + i, count - i, dest + i * stride, stride);
+}
+
+BMATH_TARGET_AVX2 static void
+mat4_transform_points_avx2(const mat4 m,
+                           const f32* xs, const f32* ys, const f32* zs,
+                           const i32 count,
+                           f32* dest, const i32 stride) {
+	const __m256 m00 = _mm256_set1_ps(m[0][0]), m01 = _mm256_set1_ps(m[0][1]), m02 = _mm256_set1_ps(m[0][2]),
+	             m10 = _mm256_set1_ps(m[1][0]), m11 = _mm256_set1_ps(m[1][1]), m12 = _mm256_set1_ps(m[1][2]),
+	             m20 = _mm256_set1_ps(m[2][0]), m21 = _mm256_set1_ps(m[2][1]), m22 = _mm256_set1_ps(m[2][2]),
+	             m30 = _mm256_set1_ps(m[3][0]), m31 = _mm256_set1_ps(m[3][1]), m32 = _mm256_set1_ps(m[3][2]);
+
+	i32 i = 0;
+	for(; i + 8 <= count; i += 8) {
+		const __m256 x = _mm256_loadu_ps(xs + i);
+		const __m256 y = _mm256_loadu_ps(ys + i);
+		const __m256 z = _mm256_loadu_ps(zs + i);
+
+		const __m256 rx = _mm256_fmadd_ps(m00, x, _mm256_fmadd_ps(m10, y, _mm256_fmadd_ps(m20, z, m30)));
+		const __m256 ry = _mm256_fmadd_ps(m01, x, _mm256_fmadd_ps(m11, y, _mm256_fmadd_ps(m21, z, m31)));
+		const __m256 rz = _mm256_fmadd_ps(m02, x, _mm256_fmadd_ps(m12, y, _mm256_fmadd_ps(m22, z, m32)));
+
+		f32* d = dest + i * stride;
+		mm_store_points4(_mm256_castps256_ps128(rx),
+		                 _mm256_castps256_ps128(ry),
+		                 _mm256_castps256_ps128(rz),
+		                 d, stride);
+		mm_store_points4(_mm256_extractf128_ps(rx, 1),
+		                 _mm256_extractf128_ps(ry, 1),
+		                 _mm256_extractf128_ps(rz, 1),
+		                 d + 4 * stride, stride);
+	}
+
+	mat4_transform_points_sse(m, xs + i, ys + i, zs + i, count - i, dest + i * stride, stride);
+}
+
+static mat4_transform_points_func mat4_transform_points = mat4_transform_points_sse;
+
+BMATH_TARGET_AVX2 static void
+mat4_mulv4_fma(const mat4 m, const vec4 v, vec4 dest) {
+	__m128 x;
+
+	x = _mm_mul_ps(_mm_loadu_ps(m[3]), _mm_set1_ps(v[3]));
+	x = _mm_fmadd_ps(_mm_loadu_ps(m[2]), _mm_set1_ps(v[2]), x);
+	x = _mm_fmadd_ps(_mm_loadu_ps(m[1]), _mm_set1_ps(v[1]), x);
+	x = _mm_fmadd_ps(_mm_loadu_ps(m[0]), _mm_set1_ps(v[0]), x);
+
+	_mm_storeu_ps(dest, x);
+}
+
+//Loads a column into both halves of a 256 bit register
+BMATH_TARGET_AVX2 static inline __m256
+mm256_load_dup_ps(const f32* p) {
+	const __m128 v = _mm_loadu_ps(p);
+	return _mm256_set_m128(v, v);
+}
+
+//Two columns of dest at a time, m1 sits in both halves and every half broadcasts the elements of its own column of m2
+BMATH_TARGET_AVX2 static void
+mat4_mul_avx(const mat4 m1, const mat4 m2, mat4 dest) {
+	const __m256 a0 = mm256_load_dup_ps(m1[0]), a1 = mm256_load_dup_ps(m1[1]),
+	             a2 = mm256_load_dup_ps(m1[2]), a3 = mm256_load_dup_ps(m1[3]);
+
+	for(i32 i=0; i<4; i += 2) {
+		const __m256 b = _mm256_loadu_ps(m2[i]);
+		__m256 x = _mm256_mul_ps(a0, _mm256_permute_ps(b, 0x00));
+		x = _mm256_fmadd_ps(a1, _mm256_permute_ps(b, 0x55), x);
+		x = _mm256_fmadd_ps(a2, _mm256_permute_ps(b, 0xAA), x);
+		x = _mm256_fmadd_ps(a3, _mm256_permute_ps(b, 0xFF), x);
+		_mm256_storeu_ps(dest[i], x);
+	}
+}
+
+BMATH_TARGET_AVX2 static void
+mat4_mul_rot_avx(const mat4 m1, const mat4 m2, mat4 dest) {
+	const __m128 a0 = _mm_loadu_ps(m1[0]), a1 = _mm_loadu_ps(m1[1]),
+	             a2 = _mm_loadu_ps(m1[2]), a3 = _mm_loadu_ps(m1[3]);
+	const __m256 a0x2 = _mm256_set_m128(a0, a0), a1x2 = _mm256_set_m128(a1, a1), a2x2 = _mm256_set_m128(a2, a2);
+
+	//Columns 0 and 1 together, then column 2 on its own
+	const __m256 b = _mm256_loadu_ps(m2[0]);
+	__m256 x = _mm256_mul_ps(a0x2, _mm256_permute_ps(b, 0x00));
+	x = _mm256_fmadd_ps(a1x2, _mm256_permute_ps(b, 0x55), x);
+	x = _mm256_fmadd_ps(a2x2, _mm256_permute_ps(b, 0xAA), x);
+
+	__m128 z = _mm_mul_ps(a0, _mm_set1_ps(m2[2][0]));
+	z = _mm_fmadd_ps(a1, _mm_set1_ps(m2[2][1]), z);
+	z = _mm_fmadd_ps(a2, _mm_set1_ps(m2[2][2]), z);
+
+	_mm256_storeu_ps(dest[0], x);
+	_mm_storeu_ps(dest[2], z);
+	_mm_storeu_ps(dest[3], a3);
+}
+
+/*
+  sin and cos of 4 angles at once, the cephes sinf/cosf polynomials after reducing to [-pi/4, pi/4].
+  Accurate to a couple of ulps while |x| stays under a few thousand, callers keep their angles small
+*/
+BATCH_INLINE void
+mm_sincos_ps(const __m128 x, __m128* s, __m128* c) {
+	const __m128i j  = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.63661977236f)));
+	const __m128  jf = _mm_cvtepi32_ps(j);
+
+	//pi/2 split in three so the reduction stays exact
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(jf, _mm_set1_ps(1.5703125f)));
+	r = _mm_sub_ps(r, _mm_mul_ps(jf, _mm_set1_ps(4.837512969970703125e-4f)));
+	r = _mm_sub_ps(r, _mm_mul_ps(jf, _mm_set1_ps(7.54978995489188216e-8f)));
+	const __m128 z = _mm_mul_ps(r, r);
+
+	__m128 ps = mm_fmadd(_mm_set1_ps(-1.9515295891e-4f), z, _mm_set1_ps(8.3321608736e-3f));
+	ps = mm_fmadd(ps, z, _mm_set1_ps(-1.6666654611e-1f));
+	ps = mm_fmadd(_mm_mul_ps(ps, z), r, r);
+
+	__m128 pc = mm_fmadd(_mm_set1_ps(2.443315711809948e-5f), z, _mm_set1_ps(-1.388731625493765e-3f));
+	pc = mm_fmadd(pc, z, _mm_set1_ps(4.166664568298827e-2f));
+	pc = mm_fmadd(_mm_mul_ps(pc, z), z, mm_fmadd(_mm_set1_ps(-0.5f), z, _mm_set1_ps(1.0f)));
+
+	//Odd quadrants swap sin and cos, the signs follow the quadrant
+	const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	const __m128 s_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), 30));
+	const __m128 c_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+
+	*s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps)), s_sign);
+	*c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc)), c_sign);
+}
+
+//Writes column col of 4 consecutive matrices, x, y, z and w hold that column's rows with a matrix per lane
+BATCH_INLINE void
+mm_store_columns4(__m128 x, __m128 y, __m128 z, __m128 w, mat4* dest, const i32 col) {
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(dest[0][col], x);
+	_mm_storeu_ps(dest[1][col], y);
+	_mm_storeu_ps(dest[2][col], z);
+	_mm_storeu_ps(dest[3][col], w);
+}
+
+/*
+  Inputs of mat4_compose_many in structure of arrays form, element i of every array belongs to matrix i.
+  Axes don't have to be normalized, angles are in radians
+*/
+typedef struct {
+	const f32* pos[3];
+	const f32* axis[3];
+	const f32* angle;
+	const f32* scale[3];
+} trs_arrays;
+
+//Same matrices as mat4_compose_axis_angle for count elements of in
+typedef void (*mat4_compose_many_func)(const trs_arrays* in, const i32 count, mat4* dest);
+
+static void
+mat4_compose_many_scalar(const trs_arrays* in, const i32 count, mat4* dest) {
+	for(i32 i=0; i<count; ++i) {
+		const vec3 t    = { in->pos[0][i], in->pos[1][i], in->pos[2][i] };
+		const vec3 axis = { in->axis[0][i], in->axis[1][i], in->axis[2][i] };
+		const vec3 s    = { in->scale[0][i], in->scale[1][i], in->scale[2][i] };
+		mat4_compose_axis_angle(t, axis, in->angle[i], s, dest[i]);
+	}
+}
+
+static void
+mat4_compose_many_sse(const trs_arrays* in, const i32 count, mat4* dest) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one  = _mm_set1_ps(1.0f);
+
+	i32 i = 0;
+	for(; i + 4 <= count; i += 4) {
+		__m128 ax = _mm_loadu_ps(in->axis[0] + i);
+		__m128 ay = _mm_loadu_ps(in->axis[1] + i);
+		__m128 az = _mm_loadu_ps(in->axis[2] + i);
+		const __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(mm_fmadd(ax, ax, mm_fmadd(ay, ay, _mm_mul_ps(az, az)))));
+		ax = _mm_mul_ps(ax, inv);
+		ay = _mm_mul_ps(ay, inv);
+		az = _mm_mul_ps(az, inv);
+
+		__m128 sn, c;
+		mm_sincos_ps(_mm_loadu_ps(in->angle + i), &sn, &c);
+		const __m128 t1 = _mm_sub_ps(one, c);
+
+		const __m128 xy = _mm_mul_ps(_mm_mul_ps(t1, ax), ay);
+		const __m128 xz = _mm_mul_ps(_mm_mul_ps(t1, ax), az);
+		const __m128 yz = _mm_mul_ps(_mm_mul_ps(t1, ay), az);
+		const __m128 sx = _mm_mul_ps(sn, ax), sy = _mm_mul_ps(sn, ay), sz = _mm_mul_ps(sn, az);
+
+		const __m128 scx = _mm_loadu_ps(in->scale[0] + i);
+		const __m128 scy = _mm_loadu_ps(in->scale[1] + i);
+		const __m128 scz = _mm_loadu_ps(in->scale[2] + i);
+
+		mm_store_columns4(_mm_mul_ps(mm_fmadd(_mm_mul_ps(t1, ax), ax, c), scx),
+		                  _mm_mul_ps(_mm_add_ps(xy, sz), scx),
+		                  _mm_mul_ps(_mm_sub_ps(xz, sy), scx),
+		                  zero, dest + i, 0);
+		mm_store_columns4(_mm_mul_ps(_mm_sub_ps(xy, sz), scy),
+		                  _mm_mul_ps(mm_fmadd(_mm_mul_ps(t1, ay), ay, c), scy),
+		                  _mm_mul_ps(_mm_add_ps(yz, sx), scy),
+		                  zero, dest + i, 1);
+		mm_store_columns4(_mm_mul_ps(_mm_add_ps(xz, sy), scz),
+		                  _mm_mul_ps(_mm_sub_ps(yz, sx), scz),
+		                  _mm_mul_ps(mm_fmadd(_mm_mul_ps(t1, az), az, c), scz),
+		                  zero, dest + i, 2);
+		mm_store_columns4(_mm_loadu_ps(in->pos[0] + i),
+		                  _mm_loadu_ps(in->pos[1] + i),
+		                  _mm_loadu_ps(in->pos[2] + i),
+		                  one, dest + i, 3);
+	}
+
+	const trs_arrays rest = {
+		{ in->pos[0] + i, in->pos[1] + i, in->pos[2] + i },
+		{ in->axis[0] + i, in->axis[1] + i, in->axis[2] + i },
+		in->angle + i,
+		{ in->scale[0] + i, in->scale[1] + i, in->scale[2] + i },
+	};
+	mat4_compose_many_scalar(&rest, count - i, dest + i);
+}
+
+BMATH_TARGET_AVX2 static inline void
+mm256_sincos_ps(const __m256 x, __m256* s, __m256* c) {
+	const __m256i j  = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(0.63661977236f)));
+	const __m256  jf = _mm256_cvtepi32_ps(j);
+
+	__m256 r = _mm256_fnmadd_ps(jf, _mm256_set1_ps(1.5703125f), x);
+	r = _mm256_fnmadd_ps(jf, _mm256_set1_ps(4.837512969970703125e-4f), r);
+	r = _mm256_fnmadd_ps(jf, _mm256_set1_ps(7.54978995489188216e-8f), r);
+	const __m256 z = _mm256_mul_ps(r, r);
+
+	__m256 ps = _mm256_fmadd_ps(_mm256_set1_ps(-1.9515295891e-4f), z, _mm256_set1_ps(8.3321608736e-3f));
+	ps = _mm256_fmadd_ps(ps, z, _mm256_set1_ps(-1.6666654611e-1f));
+	ps = _mm256_fmadd_ps(_mm256_mul_ps(ps, z), r, r);
+
+	__m256 pc = _mm256_fmadd_ps(_mm256_set1_ps(2.443315711809948e-5f), z, _mm256_set1_ps(-1.388731625493765e-3f));
+	pc = _mm256_fmadd_ps(pc, z, _mm256_set1_ps(4.166664568298827e-2f));
+	pc = _mm256_fmadd_ps(_mm256_mul_ps(pc, z), z, _mm256_fmadd_ps(_mm256_set1_ps(-0.5f), z, _mm256_set1_ps(1.0f)));
+
+	const __m256 swap   = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+	const __m256 s_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), 30));
+	const __m256 c_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+
+	*s = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, swap), s_sign);
+	*c = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, swap), c_sign);
+}
+
+//The low halves hold matrices 0 to 3 and the high halves 4 to 7
+BMATH_TARGET_AVX2 static inline void
+mm256_store_columns8(const __m256 x, const __m256 y, const __m256 z, const __m256 w, mat4* dest, const i32 col) {
+	mm_store_columns4(_mm256_castps256_ps128(x), _mm256_castps256_ps128(y),
+	                  _mm256_castps256_ps128(z), _mm256_castps256_ps128(w), dest, col);
+	mm_store_columns4(_mm256_extractf128_ps(x, 1), _mm256_extractf128_ps(y, 1),
+	                  _mm256_extractf128_ps(z, 1), _mm256_extractf128_ps(w, 1), dest + 4, col);
+}
+
+BMATH_TARGET_AVX2 static void
+mat4_compose_many_avx2(const trs_arrays* in, const i32 count, mat4* dest) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one  = _mm256_set1_ps(1.0f);
+
+	i32 i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256 ax = _mm256_loadu_ps(in->axis[0] + i);
+		__m256 ay = _mm256_loadu_ps(in->axis[1] + i);
+		__m256 az = _mm256_loadu_ps(in->axis[2] + i);
+		const __m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(_mm256_fmadd_ps(ax, ax, _mm256_fmadd_ps(ay, ay, _mm256_mul_ps(az, az)))));
+		ax = _mm256_mul_ps(ax, inv);
+		ay = _mm256_mul_ps(ay, inv);
+		az = _mm256_mul_ps(az, inv);
+
+		__m256 sn, c;
+		mm256_sincos_ps(_mm256_loadu_ps(in->angle + i), &sn, &c);
+		const __m256 t1 = _mm256_sub_ps(one, c);
+
+		const __m256 xy = _mm256_mul_ps(_mm256_mul_ps(t1, ax), ay);
+		const __m256 xz = _mm256_mul_ps(_mm256_mul_ps(t1, ax), az);
+		const __m256 yz = _mm256_mul_ps(_mm256_mul_ps(t1, ay), az);
+		const __m256 sx = _mm256_mul_ps(sn, ax), sy = _mm256_mul_ps(sn, ay), sz = _mm256_mul_ps(sn, az);
+
+		const __m256 scx = _mm256_loadu_ps(in->scale[0] + i);
+		const __m256 scy = _mm256_loadu_ps(in->scale[1] + i);
+		const __m256 scz = _mm256_loadu_ps(in->scale[2] + i);
+
+		mm256_store_columns8(_mm256_mul_ps(_mm256_fmadd_ps(_mm256_mul_ps(t1, ax), ax, c), scx),
+		                     _mm256_mul_ps(_mm256_add_ps(xy, sz), scx),
+		                     _mm256_mul_ps(_mm256_sub_ps(xz, sy), scx),
+		                     zero, dest + i, 0);
+		mm256_store_columns8(_mm256_mul_ps(_mm256_sub_ps(xy, sz), scy),
+		                     _mm256_mul_ps(_mm256_fmadd_ps(_mm256_mul_ps(t1, ay), ay, c), scy),
+		                     _mm256_mul_ps(_mm256_add_ps(yz, sx), scy),
+		                     zero, dest + i, 1);
+		mm256_store_columns8(_mm256_mul_ps(_mm256_add_ps(xz, sy), scz),
+		                     _mm256_mul_ps(_mm256_sub_ps(yz, sx), scz),
+		                     _mm256_mul_ps(_mm256_fmadd_ps(_mm256_mul_ps(t1, az), az, c), scz),
+		                     zero, dest + i, 2);
+		mm256_store_columns8(_mm256_loadu_ps(in->pos[0] + i),
+		                     _mm256_loadu_ps(in->pos[1] + i),
+		                     _mm256_loadu_ps(in->pos[2] + i),
+		                     one, dest + i, 3);
+	}
+
+	const trs_arrays rest = {
+		{ in->pos[0] + i, in->pos[1] + i, in->pos[2] + i },
+		{ in->axis[0] + i, in->axis[1] + i, in->axis[2] + i },
+		in->angle + i,
+		{ in->scale[0] + i, in->scale[1] + i, in->scale[2] + i },
+	};
+	mat4_compose_many_sse(&rest, count - i, dest + i);
+}
+
+static mat4_compose_many_func mat4_compose_many = mat4_compose_many_sse;
+
+/*
+  Matrices of count transforms, the bulk form of transform_to_mat4.
+  4 or 8 transforms are loaded and transposed so every lane holds one of them, then built like mat4_compose_many
+*/
+typedef void (*transforms_to_mat4_func)(const transform* in, const i32 count, mat4* dest);
+
+static void
+transforms_to_mat4_scalar(const transform* in, const i32 count, mat4* dest) {
+	for(i32 i=0; i<count; ++i) {
+		transform_to_mat4(in + i, dest[i]);
+	}
+}
+
+static void
+transforms_to_mat4_sse(const transform* in, const i32 count, mat4* dest) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one  = _mm_set1_ps(1.0f);
+
+	i32 i = 0;
+	for(; i + 4 <= count; i += 4) {
+		//Each transform is read as floats 0-3, 4-7 and 8-9: px py pz qx | qy qz qw sx | sy sz
+		const f32* t = (const f32*)(in + i);
+		const i32 n = sizeof(transform) / sizeof(f32);
+
+		__m128 px = _mm_loadu_ps(t + 0 * n), py = _mm_loadu_ps(t + 1 * n),
+		       pz = _mm_loadu_ps(t + 2 * n), qx = _mm_loadu_ps(t + 3 * n);
+		_MM_TRANSPOSE4_PS(px, py, pz, qx);
+
+		__m128 qy = _mm_loadu_ps(t + 0 * n + 4), qz = _mm_loadu_ps(t + 1 * n + 4),
+		       qw = _mm_loadu_ps(t + 2 * n + 4), sx = _mm_loadu_ps(t + 3 * n + 4);
+		_MM_TRANSPOSE4_PS(qy, qz, qw, sx);
+
+		const __m128 s01 = _mm_loadh_pi(_mm_loadl_pi(zero, (const __m64*)(t + 0 * n + 8)), (const __m64*)(t + 1 * n + 8));
+		const __m128 s23 = _mm_loadh_pi(_mm_loadl_pi(zero, (const __m64*)(t + 2 * n + 8)), (const __m64*)(t + 3 * n + 8));
+		const __m128 sy  = _mm_shuffle_ps(s01, s23, _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 sz  = _mm_shuffle_ps(s01, s23, _MM_SHUFFLE(3, 1, 3, 1));
+
+		const __m128 x2 = _mm_add_ps(qx, qx), y2 = _mm_add_ps(qy, qy), z2 = _mm_add_ps(qz, qz);
+		const __m128 xx = _mm_mul_ps(qx, x2), yy = _mm_mul_ps(qy, y2), zz = _mm_mul_ps(qz, z2);
+		const __m128 xy = _mm_mul_ps(qx, y2), xz = _mm_mul_ps(qx, z2), yz = _mm_mul_ps(qy, z2);
+		const __m128 wx = _mm_mul_ps(qw, x2), wy = _mm_mul_ps(qw, y2), wz = _mm_mul_ps(qw, z2);
+
+		mm_store_columns4(_mm_mul_ps(_mm_sub_ps(_mm_sub_ps(one, yy), zz), sx),
+		                  _mm_mul_ps(_mm_add_ps(xy, wz), sx),
+		                  _mm_mul_ps(_mm_sub_ps(xz, wy), sx),
+		                  zero, dest + i, 0);
+		mm_store_columns4(_mm_mul_ps(_mm_sub_ps(xy, wz), sy),
+		                  _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(one, xx), zz), sy),
+		                  _mm_mul_ps(_mm_add_ps(yz, wx), sy),
+		                  zero, dest + i, 1);
+		mm_store_columns4(_mm_mul_ps(_mm_add_ps(xz, wy), sz),
+		                  _mm_mul_ps(_mm_sub_ps(yz, wx), sz),
+		                  _mm_mul_ps(_mm_sub_ps(_mm_sub_ps(one, xx), yy), sz),
+		                  zero, dest + i, 2);
+		mm_store_columns4(px, py, pz, one, dest + i, 3);
+	}
+
+	transforms_to_mat4_scalar(in + i, count - i, dest + i);
+}
+
+//_MM_TRANSPOSE4_PS within each 128 bit half
+#define MM256_TRANSPOSE4_LANES_PS(r0, r1, r2, r3)                   \
+	do {                                                            \
+		const __m256 t0_ = _mm256_unpacklo_ps((r0), (r1));          \
+		const __m256 t1_ = _mm256_unpacklo_ps((r2), (r3));          \
+		const __m256 t2_ = _mm256_unpackhi_ps((r0), (r1));          \
+		const __m256 t3_ = _mm256_unpackhi_ps((r2), (r3));          \
+		(r0) = _mm256_shuffle_ps(t0_, t1_, _MM_SHUFFLE(1, 0, 1, 0)); \
+		(r1) = _mm256_shuffle_ps(t0_, t1_, _MM_SHUFFLE(3, 2, 3, 2)); \
+		(r2) = _mm256_shuffle_ps(t2_, t3_, _MM_SHUFFLE(1, 0, 1, 0)); \
+		(r3) = _mm256_shuffle_ps(t2_, t3_, _MM_SHUFFLE(3, 2, 3, 2)); \
+	} while(0)
+
+//Transform k goes in the low half and k + 4 in the high half, matching mm256_store_columns8
+BMATH_TARGET_AVX2 static inline __m256
+mm256_load_pair_ps(const f32* lo, const f32* hi) {
+	return _mm256_set_m128(_mm_loadu_ps(hi), _mm_loadu_ps(lo));
+}
+
+BMATH_TARGET_AVX2 static void
+transforms_to_mat4_avx2(const transform* in, const i32 count, mat4* dest) {
+	const __m256 zero = _mm256_setzero_ps();
+	const __m256 one  = _mm256_set1_ps(1.0f);
+
+	i32 i = 0;
+	for(; i + 8 <= count; i += 8) {
+		const f32* t = (const f32*)(in + i);
+		const i32 n = sizeof(transform) / sizeof(f32);
+
+		__m256 px = mm256_load_pair_ps(t + 0 * n, t + 4 * n), py = mm256_load_pair_ps(t + 1 * n, t + 5 * n),
+		       pz = mm256_load_pair_ps(t + 2 * n, t + 6 * n), qx = mm256_load_pair_ps(t + 3 * n, t + 7 * n);
+		MM256_TRANSPOSE4_LANES_PS(px, py, pz, qx);
+
+		__m256 qy = mm256_load_pair_ps(t + 0 * n + 4, t + 4 * n + 4), qz = mm256_load_pair_ps(t + 1 * n + 4, t + 5 * n + 4),
+		       qw = mm256_load_pair_ps(t + 2 * n + 4, t + 6 * n + 4), sx = mm256_load_pair_ps(t + 3 * n + 4, t + 7 * n + 4);
+		MM256_TRANSPOSE4_LANES_PS(qy, qz, qw, sx);
+
+		//sy and sz are the last two floats of every transform, gathered so nothing is read past the array
+		const __m256i idx = _mm256_setr_epi32(0 * n + 8, 1 * n + 8, 2 * n + 8, 3 * n + 8,
+		                                      4 * n + 8, 5 * n + 8, 6 * n + 8, 7 * n + 8);
+		const __m256 sy = _mm256_i32gather_ps(t, idx, 4);
+		const __m256 sz = _mm256_i32gather_ps(t + 1, idx, 4);
+
+		const __m256 x2 = _mm256_add_ps(qx, qx), y2 = _mm256_add_ps(qy, qy), z2 = _mm256_add_ps(qz, qz);
+		const __m256 xx = _mm256_mul_ps(qx, x2), yy = _mm256_mul_ps(qy, y2), zz = _mm256_mul_ps(qz, z2);
+		const __m256 xy = _mm256_mul_ps(qx, y2), xz = _mm256_mul_ps(qx, z2), yz = _mm256_mul_ps(qy, z2);
+		const __m256 wx = _mm256_mul_ps(qw, x2), wy = _mm256_mul_ps(qw, y2), wz = _mm256_mul_ps(qw, z2);
+
+		mm256_store_columns8(_mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, yy), zz), sx),
+		                     _mm256_mul_ps(_mm256_add_ps(xy, wz), sx),
+		                     _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx),
+		                     zero, dest + i, 0);
+		mm256_store_columns8(_mm256_mul_ps(_mm256_sub_ps(xy, wz), sy),
+		                     _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, xx), zz), sy),
+		                     _mm256_mul_ps(_mm256_add_ps(yz, wx), sy),
+		                     zero, dest + i, 1);
+		mm256_store_columns8(_mm256_mul_ps(_mm256_add_ps(xz, wy), sz),
+		                     _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz),
+		                     _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(one, xx), yy), sz),
+		                     zero, dest + i, 2);
+		mm256_store_columns8(px, py, pz, one, dest + i, 3);
+	}
+
+	transforms_to_mat4_sse(in + i, count - i, dest + i);
+}
+
+static transforms_to_mat4_func transforms_to_mat4 = transforms_to_mat4_sse;
+
+//Picks the fastest kernels the running cpu supports, must be called once before any worker thread uses them
+static void
+bmath_init(void) {
+	__builtin_cpu_init();
+	bmath_cpu.avx2_fma = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+
+	if(bmath_cpu.avx2_fma) {
+		mat4_transform_points = mat4_transform_points_avx2;
+		mat4_mulv4            = mat4_mulv4_fma;
+		mat4_mul              = mat4_mul_avx;
+		mat4_mul_rot          = mat4_mul_rot_avx;
+		mat4_compose_many     = mat4_compose_many_avx2;
+		transforms_to_mat4    = transforms_to_mat4_avx2;
+	}
+}
+
 #endif
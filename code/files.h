@@ -0,0 +1,101 @@
+#if !defined(FILES_H)
+#define FILES_H
+
+/*
+  Read only files mapped into memory instead of copied into malloc'd buffers, pages are only read when touched.
+  Mappings are refcounted and shared by path, so mapping a file that's already mapped just adds a reference.
+  The pages are read from the file itself, so it must not be written or truncated while it's mapped,
+  writes show up in the mapping and reads past a truncated end crash with SIGBUS.
+  Only meant to be used from the main thread.
+*/
+
+typedef enum {
+	FILE_ACCESS_SEQUENTIAL, //Read once front to back, read ahead of it aggressively
+	FILE_ACCESS_RANDOM,     //Only parts are read in no order, like the tables of a big font
+} file_access;
+
+typedef struct file_mapping file_mapping;
+struct file_mapping {
+	char*         path;
+	const u8*     data;
+	size_t        size;
+	i32           refs;
+	file_mapping* next;
+};
+
+static file_mapping* file_mappings;
+
+//Returns NULL without printing when the file can't be opened, callers know best how to report it
+static file_mapping*
+file_map(const char* path, const file_access access) {
+	for(file_mapping* m = file_mappings; m; m = m->next) {
+		if(!strcmp(m->path, path)) {
+			++m->refs;
+			return m;
+		}
+	}
+
+	const i32 fd = open(path, O_RDONLY);
+	if(fd < 0) {
+		return NULL;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return NULL;
+	}
+
+	//The mapping keeps the file referenced, the descriptor isn't needed past this
+	const size_t size = (size_t)st.st_size;
+	void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(data == MAP_FAILED) {
+		printf("Failed to map %s\n", path);
+		return NULL;
+	}
+
+	if(access == FILE_ACCESS_SEQUENTIAL) {
+		madvise(data, size, MADV_SEQUENTIAL);
+		madvise(data, size, MADV_WILLNEED);
+	} else {
+		madvise(data, size, MADV_RANDOM);
+	}
+
+	file_mapping* m = (file_mapping*)malloc(sizeof(file_mapping));
+	m->path = strdup(path);
+	m->data = (const u8*)data;
+	m->size = size;
+	m->refs = 1;
+	m->next = file_mappings;
+	file_mappings = m;
+
+	return m;
+}
+
+BATCH_INLINE file_mapping*
+file_mapping_ref(file_mapping* m) {
+	++m->refs;
+	return m;
+}
+
+//Drops a reference, the last one unmaps the file, NULL is ignored
+static void
+file_unmap(file_mapping* m) {
+	if(!m || --m->refs > 0) {
+		return;
+	}
+
+	for(file_mapping** it = &file_mappings; *it; it = &(*it)->next) {
+		if(*it == m) {
+			*it = m->next;
+			break;
+		}
+	}
+
+	munmap((void*)m->data, m->size);
+	free(m->path);
+	free(m);
+}
+
+#endif
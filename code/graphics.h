@@ -1,38 +1,15 @@
 #if !defined GRAPHICS_H
 #define GRAPHICS_H
 
-BATCH_INLINE char*
-load_shader_file(const char* file_path) {
-	FILE*file;
-	long size;
-	char* shader_content;
-
-	file = fopen(file_path, "rb");
-	if(!file) {
-		printf("Failed to load shader content\n");
-		return "";
-	}
-
-	fseek(file, 0L, SEEK_END);
-	size = ftell(file) + 1;
-	fclose(file);
-
-	file = fopen(file_path, "r");
-	shader_content = memset(malloc(size), '\0', size);
-	size_t _ = fread(shader_content, 1, size-1, file);
-	fclose(file);
-
-	return shader_content;
-}
-
+//Length is the size of source in bytes, it doesn't have to be null terminated
 BATCH_INLINE shader_id
-compile_shader(i32 type, const char* source) {
+compile_shader(i32 type, const char* source, const i32 length) {
 	shader_id id = glCreateShader(type);
 	if(!id) {
 		printf("Failed to create shader\n");
 		return 0;
 	}
-	glShaderSource(id, 1, (const char**)&source, NULL);
+	glShaderSource(id, 1, &source, &length);
 	glCompileShader(id);
 	i32 compile_status;
 	glGetShaderiv(id, GL_COMPILE_STATUS, &compile_status);
@@ -49,9 +26,15 @@ compile_shader(i32 type, const char* source) {
 
 BATCH_INLINE const shader_id
 load_compile_shader(i32 type, const char* path) {
-	const char* source = load_shader_file(path);
-	const shader_id id = compile_shader(type, source);
-	free((void*)source);
+	//The driver reads the source straight out of the mapped pages
+	file_mapping* file = file_map(path, FILE_ACCESS_SEQUENTIAL);
+	if(!file) {
+		printf("Failed to load shader content\n");
+		return 0;
+	}
+
+	const shader_id id = compile_shader(type, (const char*)file->data, (i32)file->size);
+	file_unmap(file);
 
 	return id;
 }
@@ -95,6 +78,30 @@ load_create_shader_program(const char* vert_path, const char* frag_path) {
 	}
 }
 
+BATCH_INLINE const shader_program_id
+load_create_compute_program(const char* comp_path) {
+	const shader_id comp_id = load_compile_shader(GL_COMPUTE_SHADER, comp_path);
+	if(!comp_id) {
+		return 0;
+	}
+
+	shader_program_id id = glCreateProgram();
+	glAttachShader(id, comp_id);
+	glLinkProgram(id);
+	glDeleteShader(comp_id);
+
+	i32 sucess;
+	glGetProgramiv(id, GL_LINK_STATUS, &sucess);
+	if(!sucess) {
+		char info[512];
+		glGetProgramInfoLog(id, sizeof(info), NULL, info);
+		printf("Compute program failed to link:\n%s\n", info);
+		return 0;
+	}
+
+	return id;
+}
+
 BATCH_INLINE const texture
 create_texture(image img, const i32 w, const i32 h) {
 	texture texture_id;
@@ -162,6 +169,88 @@ vao_delete(const vertex_array vao) {
     glDeleteBuffers     (1, &vao.ebo);
 }
 
+BATCH_INLINE stream_buffer
+stream_buffer_init(const u32 region_size) {
+	stream_buffer sb = {};
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	//Regions are kept aligned so their offsets can be bound as any kind of buffer
+	sb.region_size = (region_size + 255) & ~255u;
+
+	glCreateBuffers(1, &sb.id);
+	glNamedBufferStorage(sb.id, sb.region_size * STREAM_BUFFER_REGIONS, NULL, flags);
+	sb.data = (u8*)glMapNamedBufferRange(sb.id, 0, sb.region_size * STREAM_BUFFER_REGIONS, flags);
+	if(!sb.data) {
+		printf("Stream buffer could not be mapped\n");
+	}
+
+	return sb;
+}
+
+BATCH_INLINE void
+stream_buffer_delete(stream_buffer* sb) {
+	for(i32 i=0; i<STREAM_BUFFER_REGIONS; ++i) {
+		if(sb->fences[i]) {
+			glDeleteSync(sb->fences[i]);
+		}
+	}
+	glUnmapNamedBuffer(sb->id);
+	glDeleteBuffers(1, &sb->id);
+	*sb = (stream_buffer){};
+}
+
+//Returns the current region ready to be written, waits only if the gpu hasn't finished with it yet
+BATCH_INLINE void*
+stream_buffer_begin(stream_buffer* sb) {
+	GLsync fence = sb->fences[sb->region];
+	if(fence) {
+		GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while(status == GL_TIMEOUT_EXPIRED) {
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+		glDeleteSync(fence);
+		sb->fences[sb->region] = 0;
+	}
+
+	return sb->data + sb->region * sb->region_size;
+}
+
+BATCH_INLINE const u32
+stream_buffer_offset(const stream_buffer* sb) {
+	return sb->region * sb->region_size;
+}
+
+//Must be called after the draws reading the current region were issued
+BATCH_INLINE void
+stream_buffer_end(stream_buffer* sb) {
+	sb->fences[sb->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	sb->region = (sb->region + 1) % STREAM_BUFFER_REGIONS;
+}
+
+BATCH_INLINE const stream_vertex_array
+stream_vao_init(const u32 region_size) {
+	stream_vertex_array vao;
+	glCreateVertexArrays(1, &vao.id);
+	glCreateBuffers     (1, &vao.ebo);
+	glVertexArrayElementBuffer(vao.id, vao.ebo);
+	vao.vbo = stream_buffer_init(region_size);
+
+	return vao;
+}
+
+BATCH_INLINE void
+stream_vao_delete(stream_vertex_array* vao) {
+	glDeleteVertexArrays(1, &vao->id);
+	glDeleteBuffers     (1, &vao->ebo);
+	stream_buffer_delete(&vao->vbo);
+}
+
+//Points binding 0 of the vertex array to the region that was just written
+BATCH_INLINE void
+stream_vao_bind_region(const stream_vertex_array* vao, const i32 stride) {
+	glVertexArrayVertexBuffer(vao->id, 0, vao->vbo.id, stream_buffer_offset(&vao->vbo), stride);
+}
+
 //I would have passed it by scene_vertex but that doesn't work
 BATCH_INLINE void
 fill_scene_vertex(cube data,
@@ -195,6 +284,11 @@ fill_cube_elements(cube_elements data, const i32 offset) {
 	data[33] = 22 + i; data[34] = 23 + i; data[35] = 20 + i;
 }
 
+//Same topology as fill_cube_elements for a single cube, meant to be offset with a base vertex or instancing
+static const u16 cube_indices[36] = {  0,  3,  2,  2,  1,  0,  4,  5,  6,  6,  7,  4,
+                                      11,  8,  9,  9, 10, 11, 12, 13, 14, 14, 15, 12,
+                                      16, 17, 18, 18, 19, 16, 20, 21, 22, 22, 23, 20 };
+
 BATCH_INLINE void
 make_cube(cube data) {
 	//data[0].v.pos[0] = -0.5f; data[0].v.pos[1] = -0.5f; data[0].v.pos[2] = -0.5f; data[0].v.uv[0] = 0.0f; data[0].v.uv[1] = 0.0f;
@@ -226,16 +320,49 @@ make_cube(cube data) {
 	fill_scene_vertex(data, 23,  0.5f,  0.5f,  0.5f, 0.0f, 1.0f);
 }
 
-/*!Warn, this function is slow, in a real project transformations should be optimized as much as possible 
-this function only works given the scope of the project*/
+//Unit cube positions in the same order as make_cube, as structure of arrays for the batch transform
+static const f32 cube_pos_x[24] = { -0.5f,  0.5f,  0.5f, -0.5f, -0.5f,  0.5f,  0.5f, -0.5f,
+                                    -0.5f, -0.5f, -0.5f, -0.5f,  0.5f,  0.5f,  0.5f,  0.5f,
+                                    -0.5f,  0.5f,  0.5f, -0.5f,  0.5f, -0.5f, -0.5f,  0.5f };
+static const f32 cube_pos_y[24] = { -0.5f, -0.5f,  0.5f,  0.5f, -0.5f, -0.5f,  0.5f,  0.5f,
+                                     0.5f, -0.5f, -0.5f,  0.5f, -0.5f,  0.5f,  0.5f, -0.5f,
+                                    -0.5f, -0.5f, -0.5f, -0.5f,  0.5f,  0.5f,  0.5f,  0.5f };
+static const f32 cube_pos_z[24] = { -0.5f, -0.5f, -0.5f, -0.5f,  0.5f,  0.5f,  0.5f,  0.5f,
+                                    -0.5f, -0.5f,  0.5f,  0.5f, -0.5f, -0.5f,  0.5f,  0.5f,
+                                    -0.5f, -0.5f,  0.5f,  0.5f, -0.5f, -0.5f,  0.5f,  0.5f };
+
+/*Writes the unit cube transformed by model into the positions of data, uvs are left as make_cube wrote them
+  Positions are read from the constant unit cube so it doesn't matter what data held before*/
 /*--Possible Optimizations--
-  *Use an array of matrices on the gpu instead of calculating the model on the cpu and have an extra vertex float to indicate the index
-  *Raw calculation similar to the one done in make_quad, maybe even removing matrices and unifying the cube creation process
+  *Use an array of matrices on the gpu instead of calculating the model on the cpu (see the instanced mode)
 */
 BATCH_INLINE void
 transform_cube(cube data, const mat4 model) {
+	mat4_transform_points(model,
+	                      cube_pos_x, cube_pos_y, cube_pos_z,
+	                      24,
+	                      data[0].v.pos, sizeof(scene_vertex) / sizeof(f32));
+}
+
+//Same as transform_cube but quantizes the result, origin and inv_extent map the batch bounds to [-1, 1]
+BATCH_INLINE void
+transform_packed_cube(packed_cube data, const mat4 model, const vec3 origin, const vec3 inv_extent) {
+	//One extra float so the last vertex can be loaded as a full vector, zeroed since nothing writes it
+	f32 pos[24 * 3 + 1];
+	pos[24 * 3] = 0.0f;
+	mat4_transform_points(model, cube_pos_x, cube_pos_y, cube_pos_z, 24, pos, 3);
+
+	const __m128 o = _mm_setr_ps(origin[0], origin[1], origin[2], 0.0f);
+	const __m128 s = _mm_setr_ps(inv_extent[0] * 32767.0f, inv_extent[1] * 32767.0f, inv_extent[2] * 32767.0f, 0.0f);
+
+	//Every face of make_cube uses the same uv corners
+	static const u32 face_uvs[4] = { 0x00000000u, 0x0000ffffu, 0xffffffffu, 0xffff0000u };
+
 	for(i32 i=0; i<24; ++i) {
-		mat4_mulv3(model, 1.0f, data[i].v.pos, data[i].v.pos);
+		const __m128 p = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pos + i * 3), o), s);
+		const __m128i q = _mm_packs_epi32(_mm_cvtps_epi32(p), _mm_setzero_si128());
+		_mm_storel_epi64((__m128i*)data[i].pos, q);
+		memcpy(data[i].uv, &face_uvs[i & 3], sizeof(data[i].uv));
 	}
 }
 #endif
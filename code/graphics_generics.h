@@ -11,6 +11,27 @@ typedef struct {
 	u32 ebo;
 } vertex_array;
 
+/*
+  Persistently mapped buffer split in regions that are written in turns,
+  a fence per region makes sure the cpu never writes a region the gpu is still reading from
+*/
+#define STREAM_BUFFER_REGIONS 3
+
+typedef struct {
+	u32    id;
+	u8*    data;
+	u32    region_size;
+	u32    region;
+	GLsync fences[STREAM_BUFFER_REGIONS];
+} stream_buffer;
+
+//Vertex array whose vertices are streamed every frame, the vertex buffer is bound per region
+typedef struct {
+	u32           id;
+	u32           ebo;
+	stream_buffer vbo;
+} stream_vertex_array;
+
 typedef union {
 	f32 data[5];
 	struct {
@@ -21,8 +42,29 @@ typedef union {
 
 typedef scene_vertex cube[24];
 
+//Layout of GL_DRAW_INDIRECT_BUFFER commands for glMultiDrawElementsIndirect
+typedef struct {
+	u32 count;
+	u32 instance_count;
+	u32 first_index;
+	i32 base_vertex;
+	u32 base_instance;
+} draw_elements_command;
+
 typedef i32 cube_elements[36];
 
+/*
+  Compact scene vertex, 12 bytes instead of 20
+  [pos] = snorm16 position relative to the batch origin and extent, the 4th component is padding
+  [uv ] = unorm16 texture coordinate
+*/
+typedef struct {
+	i16 pos[4];
+	u16 uv[2];
+} packed_scene_vertex;
+
+typedef packed_scene_vertex packed_cube[24];
+
 /*
   [0-1] = Position x,y
   [2-3] = Texture coordinate
@@ -33,6 +75,18 @@ typedef i32 cube_elements[36];
 typedef f32 hud_vertex[5];
 typedef hud_vertex quad[4];
 
+/*
+  One glyph of text, drawn as an instance and expanded into a quad by the vertex shader.
+  Position and size are in quarter units, uvs are unorm, 24 bytes against 80 for a quad plus its indices.
+*/
+typedef struct {
+	i16 pos[2];   //Bottom left corner
+	u16 size[2];
+	u16 uv[4];    //Min then max
+	u8  color[4];
+	u32 layer;
+} glyph_instance;
+
 #define CUBE_VERTICES { {-0.5f, -0.5f, -0.5f,  0.0f, 0.0f, }, \
                         { 0.5f, -0.5f, -0.5f,  1.0f, 0.0f,  }, \
                         { 0.5f,  0.5f, -0.5f,  1.0f, 1.0f,  }, \
@@ -0,0 +1,163 @@
+#if !defined(JOBS_H)
+#define JOBS_H
+
+/*
+  Small persistent worker pool with a parallel for.
+  The calling thread also takes part in the work, so a pool with no workers just runs the loop inline.
+  Ranges handed to the callback never overlap, callbacks are expected to write only inside their range.
+*/
+
+typedef void (*job_range_func)(const i32 begin, const i32 end, void* user_data);
+
+typedef struct {
+	SDL_Thread**   threads;
+	i32            thread_count;
+
+	SDL_mutex*     mutex;
+	SDL_cond*      work_cond;
+	SDL_cond*      done_cond;
+	u32            generation;
+	i32            active;
+	bool           quit;
+
+	//Current job
+	job_range_func func;
+	void*          user_data;
+	i32            count;
+	i32            batch_size;
+	SDL_atomic_t   next;
+} job_pool;
+
+static void
+job_pool_run_batches(job_pool* pool) {
+	const i32 count      = pool->count;
+	const i32 batch_size = pool->batch_size;
+
+	for(;;) {
+		const i32 begin = SDL_AtomicAdd(&pool->next, batch_size);
+		if(begin >= count) {
+			break;
+		}
+
+		const i32 end = begin + batch_size < count ? begin + batch_size : count;
+		pool->func(begin, end, pool->user_data);
+	}
+}
+
+static int
+job_pool_worker(void* data) {
+	job_pool* pool = (job_pool*)data;
+	u32 seen_generation = 0;
+
+	for(;;) {
+		SDL_LockMutex(pool->mutex);
+		while(pool->generation == seen_generation && !pool->quit) {
+			SDL_CondWait(pool->work_cond, pool->mutex);
+		}
+		if(pool->quit) {
+			SDL_UnlockMutex(pool->mutex);
+			break;
+		}
+		seen_generation = pool->generation;
+		SDL_UnlockMutex(pool->mutex);
+
+		job_pool_run_batches(pool);
+
+		SDL_LockMutex(pool->mutex);
+		if(--pool->active == 0) {
+			SDL_CondSignal(pool->done_cond);
+		}
+		SDL_UnlockMutex(pool->mutex);
+	}
+
+	return 0;
+}
+
+//Workers keep a pointer to the pool, so it's initialized in place and must not be moved afterwards
+//thread_count is the number of extra threads, a negative value uses one per core minus the calling thread
+static void
+job_pool_init(job_pool* pool, i32 thread_count) {
+	*pool = (job_pool){};
+
+	if(thread_count < 0) {
+		thread_count = SDL_GetCPUCount() - 1;
+	}
+
+	pool->mutex     = SDL_CreateMutex();
+	pool->work_cond = SDL_CreateCond();
+	pool->done_cond = SDL_CreateCond();
+	if(!pool->mutex || !pool->work_cond || !pool->done_cond) {
+		printf("Job pool could not be created, running single threaded\n");
+		return;
+	}
+
+	pool->threads = (SDL_Thread**)malloc(sizeof(SDL_Thread*) * (thread_count > 0 ? thread_count : 1));
+	for(i32 i=0; i<thread_count; ++i) {
+		SDL_Thread* thread = SDL_CreateThread(job_pool_worker, "batchman_worker", pool);
+		if(!thread) {
+			printf("Worker thread could not be created\n");
+			break;
+		}
+		pool->threads[pool->thread_count++] = thread;
+	}
+}
+
+static void
+job_pool_destroy(job_pool* pool) {
+	if(pool->mutex) {
+		SDL_LockMutex(pool->mutex);
+		pool->quit = true;
+		SDL_CondBroadcast(pool->work_cond);
+		SDL_UnlockMutex(pool->mutex);
+	}
+
+	for(i32 i=0; i<pool->thread_count; ++i) {
+		SDL_WaitThread(pool->threads[i], NULL);
+	}
+
+	free(pool->threads);
+	SDL_DestroyCond(pool->work_cond);
+	SDL_DestroyCond(pool->done_cond);
+	SDL_DestroyMutex(pool->mutex);
+	*pool = (job_pool){};
+}
+
+//Splits [0, count) across the workers and the calling thread, returns once every range is done
+static void
+job_parallel_for(job_pool* pool, const i32 count, const i32 min_batch, job_range_func func, void* user_data) {
+	if(count <= 0) {
+		return;
+	}
+
+	if(!pool->thread_count || count <= min_batch) {
+		func(0, count, user_data);
+		return;
+	}
+
+	//A few batches per thread so threads that finish early can steal the rest
+	i32 batch_size = count / ((pool->thread_count + 1) * 4);
+	if(batch_size < min_batch) {
+		batch_size = min_batch;
+	}
+
+	SDL_LockMutex(pool->mutex);
+	pool->func       = func;
+	pool->user_data  = user_data;
+	pool->count      = count;
+	pool->batch_size = batch_size;
+	pool->active     = pool->thread_count;
+	SDL_AtomicSet(&pool->next, 0);
+	++pool->generation;
+	SDL_CondBroadcast(pool->work_cond);
+	SDL_UnlockMutex(pool->mutex);
+
+	job_pool_run_batches(pool);
+
+	SDL_LockMutex(pool->mutex);
+	while(pool->active > 0) {
+		SDL_CondWait(pool->done_cond, pool->mutex);
+	}
+	SDL_UnlockMutex(pool->mutex);
+}
+
+#endif
@@ -0,0 +1,150 @@
+#if !defined(PERF_H)
+#define PERF_H
+
+/*
+  Cpu time of every frame split into stages, kept for the last PERF_HISTORY frames.
+  A mark charges the time since the previous mark to its stage, so stages never nest
+  and the stages of a frame always add up to the whole frame.
+*/
+typedef enum {
+	PERF_STAGE_EVENTS,
+	PERF_STAGE_BUILD,   //Culling and building the scene, scene vertices are written into mapped memory here
+	PERF_STAGE_UPLOAD,  //Copies into stream buffers that aren't part of a build, the hud text
+	PERF_STAGE_DRAW,
+	PERF_STAGE_SWAP,
+	PERF_STAGE_COUNT,
+} perf_stage;
+
+static const char* perf_stage_names[PERF_STAGE_COUNT] = {
+	"Events",
+	"Build",
+	"Upload",
+	"Draw",
+	"Swap",
+};
+
+#define PERF_HISTORY 128
+
+//Overlay layout in hud units, the graph is scaled so PERF_GRAPH_MS fills it
+#define PERF_BAR_WIDTH    4.0f
+#define PERF_GRAPH_HEIGHT 200.0f
+#define PERF_GRAPH_MS     50.0f
+#define PERF_TEXT_SIZE    0.4f
+
+typedef struct {
+	f64 ms_per_tick;
+	u64 last_mark;
+	u64 stage_ticks[PERF_STAGE_COUNT];
+
+	//Counted through the frame, shown for the frame before
+	u32 draw_calls;
+	u32 upload_bytes;
+	u32 last_draw_calls;
+	u32 last_upload_bytes;
+
+	f32 frame_ms[PERF_HISTORY];
+	f32 stage_ms[PERF_STAGE_COUNT];  //Smoothed, a single frame is too noisy to read
+	f32 overlay_ms;
+	i32 frame;
+} perf_stats;
+
+BATCH_INLINE void
+perf_init(perf_stats* perf) {
+	*perf = (perf_stats){};
+	perf->ms_per_tick = 1000.0 / (f64)SDL_GetPerformanceFrequency();
+	perf->last_mark   = SDL_GetPerformanceCounter();
+}
+
+BATCH_INLINE void
+perf_mark(perf_stats* perf, const perf_stage stage) {
+	const u64 now = SDL_GetPerformanceCounter();
+	perf->stage_ticks[stage] += now - perf->last_mark;
+	perf->last_mark = now;
+}
+
+BATCH_INLINE void
+perf_count(perf_stats* perf, const u32 draw_calls, const u32 upload_bytes) {
+	perf->draw_calls   += draw_calls;
+	perf->upload_bytes += upload_bytes;
+}
+
+//Closes the frame, the last stage has to be marked before this
+static void
+perf_end_frame(perf_stats* perf) {
+	u64 frame_ticks = 0;
+	for(i32 i=0; i<PERF_STAGE_COUNT; ++i) {
+		const f32 ms = (f32)(perf->stage_ticks[i] * perf->ms_per_tick);
+		perf->stage_ms[i] += (ms - perf->stage_ms[i]) * 0.1f;
+		frame_ticks += perf->stage_ticks[i];
+		perf->stage_ticks[i] = 0;
+	}
+
+	perf->frame_ms[perf->frame++ % PERF_HISTORY] = (f32)(frame_ticks * perf->ms_per_tick);
+
+	perf->last_draw_calls   = perf->draw_calls;
+	perf->last_upload_bytes = perf->upload_bytes;
+	perf->draw_calls   = 0;
+	perf->upload_bytes = 0;
+}
+
+/*
+  Pushes the frame time graph and the stage timings into stream, left and top are the hud position of the top left corner.
+  Oldest frames are on the left, the lines are at 60 and 30 fps.
+  The glyphs are drawn when the stream is flushed, the caller ends it
+*/
+static void
+perf_draw(perf_stats* perf, text_stream* stream, font* f, const f32 left, const f32 top) {
+	const u64 begin = SDL_GetPerformanceCounter();
+
+	const u8 background[4] = { 0, 0, 0, 160 };
+	const u8 line_color[4] = { 255, 255, 255, 90 };
+	const u8 good_color[4] = { 80, 220, 80, 255 };
+	const u8 slow_color[4] = { 240, 200, 60, 255 };
+	const u8 bad_color[4]  = { 240, 70, 60, 255 };
+	const u8 text_color[4] = { 255, 255, 255, 255 };
+
+	const f32 graph_w = PERF_BAR_WIDTH * PERF_HISTORY;
+	const f32 bottom  = top - PERF_GRAPH_HEIGHT;
+	const f32 scale   = PERF_GRAPH_HEIGHT / PERF_GRAPH_MS;
+	const f32 text_h  = f->line_height * PERF_TEXT_SIZE;
+	const f32 texts_h = text_h * (PERF_STAGE_COUNT + 6);
+
+	glyph_instance quad;
+	make_solid_instance(&quad, left, bottom - texts_h, graph_w, PERF_GRAPH_HEIGHT + texts_h, background);
+	text_stream_push(stream, &quad);
+
+	f32 max_ms = 0.0f;
+	f32 sum_ms = 0.0f;
+	const i32 frames = perf->frame < PERF_HISTORY ? perf->frame : PERF_HISTORY;
+	for(i32 i=0; i<frames; ++i) {
+		const f32 ms = perf->frame_ms[(perf->frame - frames + i) % PERF_HISTORY];
+		const f32 bar_h = ms < PERF_GRAPH_MS ? ms * scale : PERF_GRAPH_HEIGHT;
+		const u8* color = ms <= 1000.0f / 60.0f ? good_color : (ms <= 1000.0f / 30.0f ? slow_color : bad_color);
+
+		make_solid_instance(&quad, left + (PERF_HISTORY - frames + i) * PERF_BAR_WIDTH, bottom, PERF_BAR_WIDTH - 1.0f, bar_h, color);
+		text_stream_push(stream, &quad);
+
+		max_ms = ms > max_ms ? ms : max_ms;
+		sum_ms += ms;
+	}
+
+	make_solid_instance(&quad, left, bottom + scale * (1000.0f / 60.0f), graph_w, 1.0f, line_color);
+	text_stream_push(stream, &quad);
+	make_solid_instance(&quad, left, bottom + scale * (1000.0f / 30.0f), graph_w, 1.0f, line_color);
+	text_stream_push(stream, &quad);
+
+	//Text goes down from the first baseline under the graph
+	vec2 pos = { left, -bottom + text_h };
+	text_stream_print(stream, f, pos, PERF_TEXT_SIZE, text_color, "Frame:%.2f ms\nAvg:%.2f Max:%.2f",
+	                  perf->frame_ms[(perf->frame + PERF_HISTORY - 1) % PERF_HISTORY], frames ? sum_ms / frames : 0.0f, max_ms);
+	for(i32 i=0; i<PERF_STAGE_COUNT; ++i) {
+		text_stream_print(stream, f, pos, PERF_TEXT_SIZE, text_color, "%s:%.3f ms", perf_stage_names[i], perf->stage_ms[i]);
+	}
+	text_stream_print(stream, f, pos, PERF_TEXT_SIZE, text_color, "Draws:%u\nUpload:%u bytes\nOverlay:%.3f ms",
+	                  perf->last_draw_calls, perf->last_upload_bytes, perf->overlay_ms);
+
+	const f32 overlay_ms = (f32)((SDL_GetPerformanceCounter() - begin) * perf->ms_per_tick);
+	perf->overlay_ms += (overlay_ms - perf->overlay_ms) * 0.1f;
+}
+
+#endif
@@ -0,0 +1,257 @@
+#if !defined(SCENE_H)
+#define SCENE_H
+
+//Radius of the bounding sphere of a rotated unit cube
+#define SCENE_CUBE_RADIUS 0.8660254f
+
+//Cubes are laid out in a 10x10 grid per layer, one layer on top of the other
+BATCH_INLINE void
+scene_cube_position(const i32 i, vec3 dest) {
+	const f32 x_begin = -50.0f;
+	const f32 offset  = 1.5f;
+
+	dest[0] = x_begin + offset * (f32)(i % 10);
+	dest[1] = offset * (f32)(i / 100 + 1);
+	dest[2] = offset * (f32)((i % 100) / 10);
+}
+
+//Cube models are built this many at a time, the inputs of a chunk live on the stack
+#define SCENE_MODEL_CHUNK 64
+
+//Writes the models of count cubes into dest, every cube spins around the same axis offset by a degree per id
+static void
+scene_cube_models(const i32* ids, const i32 count, const f32 rot, mat4* dest) {
+	f32 pos[3][SCENE_MODEL_CHUNK];
+	f32 axis[3][SCENE_MODEL_CHUNK];
+	f32 angle[SCENE_MODEL_CHUNK];
+	f32 scale[SCENE_MODEL_CHUNK];
+
+	for(i32 i=0; i<SCENE_MODEL_CHUNK; ++i) {
+		axis[0][i] = 1.0f;
+		axis[1][i] = 0.3f;
+		axis[2][i] = 0.5f;
+		scale[i]   = 1.0f;
+	}
+
+	//Wrapped to keep the angles small, rot grows for as long as the program runs
+	const f32 base = fmodf(rot, 360.0f);
+	const trs_arrays in = {
+		{ pos[0], pos[1], pos[2] },
+		{ axis[0], axis[1], axis[2] },
+		angle,
+		{ scale, scale, scale },
+	};
+
+	for(i32 begin=0; begin<count; begin += SCENE_MODEL_CHUNK) {
+		const i32 n = count - begin < SCENE_MODEL_CHUNK ? count - begin : SCENE_MODEL_CHUNK;
+		for(i32 i=0; i<n; ++i) {
+			const i32 id = ids[begin + i];
+			vec3 p;
+			scene_cube_position(id, p);
+			pos[0][i] = p[0];
+			pos[1][i] = p[1];
+			pos[2][i] = p[2];
+			angle[i]  = to_radians_32(base + (f32)(id % 360));
+		}
+		mat4_compose_many(&in, n, dest + begin);
+	}
+}
+
+//Bounds of the given cubes grown by the radius of a rotated unit cube, used to quantize packed vertices per flush
+static void
+scene_cube_bounds(const i32* ids, const i32 count, vec3 min, vec3 max) {
+	min[0] = min[1] = min[2] =  INFINITY;
+	max[0] = max[1] = max[2] = -INFINITY;
+
+	for(i32 i=0; i<count; ++i) {
+		vec3 center;
+		scene_cube_position(ids[i], center);
+		for(i32 k=0; k<3; ++k) {
+			min[k] = center[k] < min[k] ? center[k] : min[k];
+			max[k] = center[k] > max[k] ? center[k] : max[k];
+		}
+	}
+
+	for(i32 k=0; k<3; ++k) {
+		min[k] -= SCENE_CUBE_RADIUS;
+		max[k] += SCENE_CUBE_RADIUS;
+	}
+}
+
+/*
+  Ranges go over the cubes of one flush, ids maps every output slot to the cube it holds
+  so the flushed cubes end up packed at the front of the output arrays
+*/
+typedef struct {
+	const i32*   ids;
+	cube*        cubes;
+	packed_cube* packed_cubes;
+	mat4*        instances;
+	f32          rot;
+	vec3         origin;
+	vec3         inv_extent;
+} scene_build_job;
+
+//Each range writes a disjoint slice of the output arrays, so ranges can run on any worker
+static void
+scene_build_batched_range(const i32 begin, const i32 end, void* user_data) {
+	const scene_build_job* job = (const scene_build_job*)user_data;
+	mat4 models[SCENE_MODEL_CHUNK];
+
+	for(i32 i=begin; i<end; i += SCENE_MODEL_CHUNK) {
+		const i32 n = end - i < SCENE_MODEL_CHUNK ? end - i : SCENE_MODEL_CHUNK;
+		scene_cube_models(job->ids + i, n, job->rot, models);
+
+		for(i32 k=0; k<n; ++k) {
+			make_cube(job->cubes[i + k]);
+			transform_cube(job->cubes[i + k], models[k]);
+		}
+	}
+}
+
+static void
+scene_build_packed_range(const i32 begin, const i32 end, void* user_data) {
+	const scene_build_job* job = (const scene_build_job*)user_data;
+	mat4 models[SCENE_MODEL_CHUNK];
+
+	for(i32 i=begin; i<end; i += SCENE_MODEL_CHUNK) {
+		const i32 n = end - i < SCENE_MODEL_CHUNK ? end - i : SCENE_MODEL_CHUNK;
+		scene_cube_models(job->ids + i, n, job->rot, models);
+
+		for(i32 k=0; k<n; ++k) {
+			transform_packed_cube(job->packed_cubes[i + k], models[k], job->origin, job->inv_extent);
+		}
+	}
+}
+
+//Models go straight into the instance array
+static void
+scene_build_instanced_range(const i32 begin, const i32 end, void* user_data) {
+	const scene_build_job* job = (const scene_build_job*)user_data;
+	scene_cube_models(job->ids + begin, end - begin, job->rot, job->instances + begin);
+}
+
+#define SCENE_JOB_MIN_BATCH 64
+
+//Switches the vertex layout the batched scene reads, both layouts share the same attribute locations
+static void
+scene_vao_set_format(const stream_vertex_array* vao, const bool packed) {
+	if(packed) {
+		glVertexArrayAttribFormat(vao->id, 0, 3, GL_SHORT, GL_TRUE, offsetof(packed_scene_vertex, pos));
+		glVertexArrayAttribFormat(vao->id, 1, 2, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(packed_scene_vertex, uv));
+	} else {
+		glVertexArrayAttribFormat(vao->id, 0, 3, GL_FLOAT, GL_FALSE, 0);
+		glVertexArrayAttribFormat(vao->id, 1, 2, GL_FLOAT, GL_FALSE, offsetof(scene_vertex, v.uv));
+	}
+}
+
+/*
+  Heap backed list of the cubes to draw this frame, it grows to any number of cubes.
+  Every time chunk_size cubes are pending they are handed to flush, which builds them into
+  one stream region and draws them, so the gpu buffers only ever need to hold one chunk.
+*/
+typedef void (*scene_flush_func)(const i32* ids, const i32 count, void* user_data);
+
+#define SCENE_BATCH_ALIGNMENT 64
+
+typedef struct {
+	i32*             ids;
+	i32              count;
+	i32              capacity;
+	i32              flushed;
+	i32              chunk_size;
+	u32              flush_count;
+	scene_flush_func flush;
+	void*            user_data;
+} scene_batch;
+
+static void
+scene_batch_reserve(scene_batch* batch, const i32 capacity) {
+	if(capacity <= batch->capacity) {
+		return;
+	}
+
+	i32 new_capacity = batch->capacity ? batch->capacity : 1024;
+	while(new_capacity < capacity) {
+		new_capacity *= 2;
+	}
+
+	i32* ids = (i32*)aligned_alloc(SCENE_BATCH_ALIGNMENT, sizeof(i32) * new_capacity);
+	if(!ids) {
+		printf("Scene batch could not grow to %d cubes\n", new_capacity);
+		return;
+	}
+	if(batch->ids) {
+		memcpy(ids, batch->ids, sizeof(i32) * batch->count);
+		free(batch->ids);
+	}
+
+	batch->ids      = ids;
+	batch->capacity = new_capacity;
+}
+
+static void
+scene_batch_free(scene_batch* batch) {
+	free(batch->ids);
+	*batch = (scene_batch){};
+}
+
+BATCH_INLINE void
+scene_batch_begin(scene_batch* batch, const i32 chunk_size, scene_flush_func flush, void* user_data) {
+	batch->count       = 0;
+	batch->flushed     = 0;
+	batch->flush_count = 0;
+	batch->chunk_size  = chunk_size;
+	batch->flush       = flush;
+	batch->user_data   = user_data;
+}
+
+BATCH_INLINE void
+scene_batch_flush(scene_batch* batch) {
+	const i32 pending = batch->count - batch->flushed;
+	if(pending > 0) {
+		batch->flush(batch->ids + batch->flushed, pending, batch->user_data);
+		batch->flushed = batch->count;
+		++batch->flush_count;
+	}
+}
+
+BATCH_INLINE void
+scene_batch_push(scene_batch* batch, const i32 id) {
+	if(batch->count == batch->capacity) {
+		scene_batch_reserve(batch, batch->count + 1);
+		if(batch->count == batch->capacity) {
+			return;
+		}
+	}
+
+	batch->ids[batch->count++] = id;
+	if(batch->count - batch->flushed == batch->chunk_size) {
+		scene_batch_flush(batch);
+	}
+}
+
+//Draws whatever is still pending
+BATCH_INLINE void
+scene_batch_end(scene_batch* batch) {
+	scene_batch_flush(batch);
+}
+
+//Pushes the cubes inside the frustum, every cube when planes is NULL
+static void
+scene_batch_push_visible(scene_batch* batch, const i32 count, const vec4 planes[6]) {
+	scene_batch_reserve(batch, count);
+
+	for(i32 i=0; i<count; ++i) {
+		if(planes) {
+			vec3 center;
+			scene_cube_position(i, center);
+			if(!frustum_test_sphere(planes, center, SCENE_CUBE_RADIUS)) {
+				continue;
+			}
+		}
+		scene_batch_push(batch, i);
+	}
+}
+
+#endif
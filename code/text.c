@@ -1,119 +1,1332 @@
 #include "text.h"
 
+#define FONT_GLYPH_PADDING 1
+
+//Distances stop being stored past this many pixels from the edge, the edge itself is at 128
+#define FONT_SDF_PADDING    4
+#define FONT_SDF_ON_EDGE    128
+#define FONT_SDF_DIST_SCALE ((f32)FONT_SDF_ON_EDGE / FONT_SDF_PADDING)
+
+BATCH_INLINE i32
+text_quantize(const f32 v, const f32 scale, const i32 lo, const i32 hi) {
+	const i32 q = (i32)lrintf(v * scale);
+	return q < lo ? lo : (q > hi ? hi : q);
+}
+
+//Decodes one codepoint and moves s past it, malformed sequences give U+FFFD and skip a single byte
+BATCH_INLINE u32
+utf8_decode(const char** s) {
+	const u8* p = (const u8*)*s;
+	u32 c = p[0];
+	u32 min;
+	i32 length;
+
+	if(c < 0x80) {
+		*s += 1;
+		return c;
+	} else if((c & 0xE0) == 0xC0) {
+		c &= 0x1F; length = 2; min = 0x80;
+	} else if((c & 0xF0) == 0xE0) {
+		c &= 0x0F; length = 3; min = 0x800;
+	} else if((c & 0xF8) == 0xF0) {
+		c &= 0x07; length = 4; min = 0x10000;
+	} else {
+		*s += 1;
+		return 0xFFFD;
+	}
+
+	//A terminator fails the continuation test, so it's never read past
+	for(i32 i=1; i<length; ++i) {
+		if((p[i] & 0xC0) != 0x80) {
+			*s += 1;
+			return 0xFFFD;
+		}
+		c = (c << 6) | (p[i] & 0x3F);
+	}
+
+	if(c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) {
+		*s += 1;
+		return 0xFFFD;
+	}
+
+	*s += length;
+	return c;
+}
+
+//Layers are cleared once here, max_layers is limited by the bits of sdf_layers
+static font_registry
+font_registry_init(const i32 w, const i32 h, const i32 max_layers) {
+	font_registry reg = {};
+	reg.w = w;
+	reg.h = h;
+	reg.max_layers = max_layers < 32 ? max_layers : 32;
+
+	const u8 zero = 0;
+	glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &reg.atlas);
+	glTextureStorage3D(reg.atlas, 1, GL_R8, w, h, reg.max_layers);
+	glClearTexImage(reg.atlas, 0, GL_RED, GL_UNSIGNED_BYTE, &zero);
+	glTextureParameteri(reg.atlas, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(reg.atlas, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(reg.atlas, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(reg.atlas, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	return reg;
+}
+
+static void
+font_registry_free(font_registry* reg) {
+	glDeleteTextures(1, &reg->atlas);
+	*reg = (font_registry){};
+}
+
+//Hashes the table directory instead of the whole file, every table record has a checksum of its contents
+//so the hash still changes with the font while only the first page of a mapped file is touched
+static u64
+font_hash_data(const u8* data, const size_t size, const i32 offset) {
+	u64 h = 0xcbf29ce484222325ull ^ (u64)size;
+	if(offset < 0 || (size_t)offset + 12 > size) {
+		return h;
+	}
+
+	const i32 table_count = (data[offset + 4] << 8) | data[offset + 5];
+	size_t end = (size_t)offset + 12 + (size_t)table_count * 16;
+	end = end < size ? end : size;
+
+	size_t i = (size_t)offset;
+	for(; i + 8 <= end; i += 8) {
+		u64 v;
+		memcpy(&v, data + i, sizeof(v));
+		h = (h ^ v) * 0x100000001b3ull;
+		h ^= h >> 29;
+	}
+	for(; i < end; ++i) {
+		h = (h ^ data[i]) * 0x100000001b3ull;
+	}
+
+	return h;
+}
+
+//The font keeps a reference to file until it's freed, it takes the next free layer of the registry
 BATCH_INLINE font
-create_font(u8* buffer, const i32 w, const i32 h, const i32 size, const i32 num_glyphs) {
+create_font(font_registry* reg, file_mapping* file, const i32 size) {
 	font f = {};
-	f.num_glyphs = num_glyphs;
-	f.w = w;
-	f.h = h;
-	f.bitmap = (u8*)malloc(w*h);
-	f.cdata = (stbtt_bakedchar*)malloc(num_glyphs*sizeof(stbtt_bakedchar));
-	stbtt_BakeFontBitmap(buffer,
-	                     0,
-	                     size,
-	                     f.bitmap,
-	                     w,
-	                     h,
-	                     32,
-	                     num_glyphs,
-	                     f.cdata);
+	f.size = size;
+	f.w = reg->w;
+	f.h = reg->h;
+	f.atlas = reg->atlas;
+	f.shelf_x = FONT_GLYPH_PADDING;
+	f.shelf_y = FONT_GLYPH_PADDING;
+
+	if(reg->layer_count == reg->max_layers) {
+		printf("Font registry is full, text won't be drawn\n");
+		return f;
+	}
+
+	//stb_truetype parses the mapped pages in place, only the tables it reads are ever paged in
+	const i32 offset = file ? stbtt_GetFontOffsetForIndex(file->data, 0) : -1;
+	if(offset < 0 || !stbtt_InitFont(&f.info, file->data, offset)) {
+		printf("Failed to read font, text won't be drawn\n");
+		return f;
+	}
+	f.file  = file_mapping_ref(file);
+	f.scale = stbtt_ScaleForPixelHeight(&f.info, (f32)size);
+	f.layer = reg->layer_count++;
+	f.hash  = font_hash_data(file->data, file->size, offset);
+
+	i32 ascent, descent, line_gap;
+	stbtt_GetFontVMetrics(&f.info, &ascent, &descent, &line_gap);
+	f.line_height = f.scale * (ascent - descent + line_gap);
+
+	f.glyph_capacity = 128;
+	f.glyphs = (font_glyph*)calloc(f.glyph_capacity, sizeof(font_glyph));
+
+	if(f.info.kern || f.info.gpos) {
+		f.kern_capacity = 256;
+		f.kerns = (font_kern*)calloc(f.kern_capacity, sizeof(font_kern));
+	}
 
 	return f;
 }
 
-BATCH_INLINE const texture
-create_font_atlas(const font f) {
-	texture atlas;
-	glCreateTextures(GL_TEXTURE_2D, 1, &atlas);
-	glBindTexture(GL_TEXTURE_2D, atlas);
-	glTexImage2D(GL_TEXTURE_2D,
-	             0,
-	             GL_R8,
-	             f.w,
-	             f.h,
-	             0,
-	             GL_RED,
-	             GL_UNSIGNED_BYTE,
-	             f.bitmap);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glBindTexture(GL_TEXTURE_2D, 0);
-
-	return atlas;
+//Size is the pixel height the distances are rasterized at, it can be a lot smaller than the size drawn
+BATCH_INLINE font
+create_sdf_font(font_registry* reg, file_mapping* file, const i32 size) {
+	font f = create_font(reg, file, size);
+	if(f.glyphs) {
+		f.sdf = true;
+		reg->sdf_layers |= 1u << f.layer;
+	}
+
+	return f;
+}
+
+BATCH_INLINE u32
+font_glyph_slot(const font_glyph* glyphs, const i32 capacity, const u32 key) {
+	const u32 mask = (u32)capacity - 1;
+	u32 i = (key * 2654435761u) & mask;
+	while(glyphs[i].key && glyphs[i].key != key) {
+		i = (i + 1) & mask;
+	}
+
+	return i;
+}
+
+static void
+font_grow_glyphs(font* f) {
+	const i32 capacity = f->glyph_capacity * 2;
+	font_glyph* glyphs = (font_glyph*)calloc(capacity, sizeof(font_glyph));
+
+	for(i32 i=0; i<f->glyph_capacity; ++i) {
+		if(f->glyphs[i].key) {
+			glyphs[font_glyph_slot(glyphs, capacity, f->glyphs[i].key)] = f->glyphs[i];
+		}
+	}
+
+	free(f->glyphs);
+	f->glyphs = glyphs;
+	f->glyph_capacity = capacity;
+}
+
+//Rasterizes the glyph into the next free spot of the current shelf and uploads just that rectangle
+static void
+font_rasterize_glyph(font* f, font_glyph* g, const u32 codepoint) {
+	i32 advance, left_bearing;
+	stbtt_GetCodepointHMetrics(&f->info, codepoint, &advance, &left_bearing);
+	g->xadvance = f->scale * advance;
+
+	i32 gw, gh;
+	u8* pixels;
+	if(f->sdf) {
+		i32 xoff, yoff;
+		pixels = stbtt_GetCodepointSDF(&f->info, f->scale, codepoint, FONT_SDF_PADDING, FONT_SDF_ON_EDGE,
+		                               FONT_SDF_DIST_SCALE, &gw, &gh, &xoff, &yoff);
+		if(!pixels) {
+			return;
+		}
+		g->xoff = (f32)xoff;
+		g->yoff = (f32)yoff;
+	} else {
+		i32 x0, y0, x1, y1;
+		stbtt_GetCodepointBitmapBox(&f->info, codepoint, f->scale, f->scale, &x0, &y0, &x1, &y1);
+		g->xoff = (f32)x0;
+		g->yoff = (f32)y0;
+
+		gw = x1 - x0;
+		gh = y1 - y0;
+		if(gw <= 0 || gh <= 0) {
+			return;
+		}
+
+		if(gw * gh > f->scratch_size) {
+			f->scratch_size = gw * gh;
+			f->scratch = (u8*)realloc(f->scratch, f->scratch_size);
+		}
+		pixels = f->scratch;
+		stbtt_MakeCodepointBitmap(&f->info, pixels, gw, gh, gw, f->scale, f->scale, codepoint);
+	}
+
+	if(f->shelf_x + gw + FONT_GLYPH_PADDING > f->w) {
+		f->shelf_x = FONT_GLYPH_PADDING;
+		f->shelf_y += f->shelf_h + FONT_GLYPH_PADDING;
+		f->shelf_h = 0;
+	}
+
+	if(gw + 2 * FONT_GLYPH_PADDING > f->w || f->shelf_y + gh + FONT_GLYPH_PADDING > f->h) {
+		printf("Font atlas is full, glyph %u won't be drawn\n", codepoint);
+	} else {
+		g->x0 = (i16)f->shelf_x;
+		g->y0 = (i16)f->shelf_y;
+		g->x1 = (i16)(f->shelf_x + gw);
+		g->y1 = (i16)(f->shelf_y + gh);
+
+		g->uv[0] = (u16)text_quantize(g->x0 * (1.0f / (f32)f->w), 65535.0f, 0, UINT16_MAX);
+		g->uv[1] = (u16)text_quantize(g->y0 * (1.0f / (f32)f->h), 65535.0f, 0, UINT16_MAX);
+		g->uv[2] = (u16)text_quantize(g->x1 * (1.0f / (f32)f->w), 65535.0f, 0, UINT16_MAX);
+		g->uv[3] = (u16)text_quantize(g->y1 * (1.0f / (f32)f->h), 65535.0f, 0, UINT16_MAX);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTextureSubImage3D(f->atlas, 0, g->x0, g->y0, f->layer, gw, gh, 1, GL_RED, GL_UNSIGNED_BYTE, pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		f->shelf_x += gw + FONT_GLYPH_PADDING;
+		f->shelf_h = gh > f->shelf_h ? gh : f->shelf_h;
+	}
+
+	if(f->sdf) {
+		stbtt_FreeSDF(pixels, NULL);
+	}
+}
+
+//Looks the glyph up and rasterizes it on first use, codepoints missing in the font get its notdef glyph
+static font_glyph
+font_get_glyph(font* f, const u32 codepoint) {
+	if(!f->glyphs) {
+		return (font_glyph){};
+	}
+
+	const u32 key = codepoint + 1;
+	u32 i = font_glyph_slot(f->glyphs, f->glyph_capacity, key);
+	if(f->glyphs[i].key == key) {
+		return f->glyphs[i];
+	}
+
+	//Kept at most half full so probes stay short
+	if((f->glyph_count + 1) * 2 > f->glyph_capacity) {
+		font_grow_glyphs(f);
+		i = font_glyph_slot(f->glyphs, f->glyph_capacity, key);
+	}
+
+	font_glyph* g = &f->glyphs[i];
+	*g = (font_glyph){};
+	g->key = key;
+	++f->glyph_count;
+	font_rasterize_glyph(f, g, codepoint);
+
+	return *g;
+}
+
+BATCH_INLINE font_cache_header
+font_cache_key(const font* f) {
+	font_cache_header header = {};
+	header.magic         = FONT_CACHE_MAGIC;
+	header.version       = FONT_CACHE_VERSION;
+	header.font_hash     = f->hash;
+	header.size          = f->size;
+	header.sdf           = f->sdf;
+	header.w             = f->w;
+	header.h             = f->h;
+	header.glyph_padding = FONT_GLYPH_PADDING;
+	header.sdf_padding   = FONT_SDF_PADDING;
+	header.glyph_size    = sizeof(font_glyph);
+
+	return header;
+}
+
+/*
+  Maps the cache file and uploads its rows straight from the mapping, the glyph table is copied as is.
+  Has to be called before the font rasterizes anything, returns false when there's no usable file
+*/
+static bool
+font_load_cache(font* f, const char* path) {
+	if(!f->glyphs || f->glyph_count) {
+		return false;
+	}
+
+	file_mapping* mapping = file_map(path, FILE_ACCESS_SEQUENTIAL);
+	if(!mapping) {
+		return false;
+	}
+	if(mapping->size < sizeof(font_cache_header)) {
+		file_unmap(mapping);
+		return false;
+	}
+
+	const u8* file = mapping->data;
+	const size_t file_size = mapping->size;
+
+	font_cache_header header;
+	memcpy(&header, file, sizeof(header));
+	const font_cache_header key = font_cache_key(f);
+
+	const size_t glyph_bytes = (size_t)header.glyph_capacity * sizeof(font_glyph);
+	const size_t pixel_bytes = (size_t)header.pixel_rows * f->w;
+	const bool valid = !memcmp(&header, &key, offsetof(font_cache_header, glyph_capacity))
+	                && header.glyph_capacity > 0 && !(header.glyph_capacity & (header.glyph_capacity - 1))
+	                && header.glyph_count >= 0 && header.glyph_count < header.glyph_capacity
+	                && header.pixel_rows >= 0 && header.pixel_rows <= f->h
+	                && file_size == sizeof(header) + glyph_bytes + pixel_bytes;
+	if(!valid) {
+		file_unmap(mapping);
+		return false;
+	}
+
+	free(f->glyphs);
+	f->glyphs = (font_glyph*)malloc(glyph_bytes);
+	memcpy(f->glyphs, file + sizeof(header), glyph_bytes);
+	f->glyph_capacity     = header.glyph_capacity;
+	f->glyph_count        = header.glyph_count;
+	f->cached_glyph_count = header.glyph_count;
+	f->shelf_x = header.shelf_x;
+	f->shelf_y = header.shelf_y;
+	f->shelf_h = header.shelf_h;
+
+	if(header.pixel_rows > 0) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTextureSubImage3D(f->atlas, 0, 0, 0, f->layer, f->w, header.pixel_rows, 1, GL_RED, GL_UNSIGNED_BYTE,
+		                    file + sizeof(header) + glyph_bytes);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	file_unmap(mapping);
+	return true;
+}
+
+//Reads the used rows of the layer back and writes the file next to the old one before replacing it
+static bool
+font_save_cache(font* f, const char* path) {
+	if(!f->glyphs) {
+		return false;
+	}
+
+	font_cache_header header = font_cache_key(f);
+	header.glyph_capacity = f->glyph_capacity;
+	header.glyph_count    = f->glyph_count;
+	header.shelf_x        = f->shelf_x;
+	header.shelf_y        = f->shelf_y;
+	header.shelf_h        = f->shelf_h;
+	header.pixel_rows     = f->shelf_y + f->shelf_h < f->h ? f->shelf_y + f->shelf_h : f->h;
+
+	const size_t pixel_bytes = (size_t)header.pixel_rows * f->w;
+	u8* pixels = (u8*)malloc(pixel_bytes ? pixel_bytes : 1);
+	if(pixel_bytes) {
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTextureSubImage(f->atlas, 0, 0, 0, f->layer, f->w, header.pixel_rows, 1, GL_RED, GL_UNSIGNED_BYTE,
+		                     (i32)pixel_bytes, pixels);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	}
+
+	char tmp_path[512];
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	FILE* file = fopen(tmp_path, "wb");
+	bool written = false;
+	if(file) {
+		written = fwrite(&header, sizeof(header), 1, file) == 1
+		       && fwrite(f->glyphs, sizeof(font_glyph), f->glyph_capacity, file) == (size_t)f->glyph_capacity
+		       && fwrite(pixels, 1, pixel_bytes, file) == pixel_bytes;
+		written = !fclose(file) && written;
+	}
+	free(pixels);
+
+	if(!written || rename(tmp_path, path) != 0) {
+		printf("Failed to write font cache %s\n", path);
+		remove(tmp_path);
+		return false;
+	}
+
+	f->cached_glyph_count = f->glyph_count;
+	return true;
+}
+
+/*
+  Loads the glyphs cached for this font in dir, the file name has the hash and size so fonts never share one.
+  Without a usable file nothing is rasterized up front, glyphs are made on first use as always
+  and font_update_cache writes the ones that were used
+*/
+static void
+font_use_cache(font* f, const char* dir) {
+	if(!f->glyphs) {
+		return;
+	}
+
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%016llx_%d%s_%dx%d.fontcache", dir,
+	         (unsigned long long)f->hash, f->size, f->sdf ? "_sdf" : "", f->w, f->h);
+	free(f->cache_path);
+	f->cache_path = strdup(path);
+
+	font_load_cache(f, path);
+}
+
+//Saves again if glyphs were rasterized since the cache was loaded or written
+BATCH_INLINE void
+font_update_cache(font* f) {
+	if(f->cache_path && f->glyph_count != f->cached_glyph_count) {
+		font_save_cache(f, f->cache_path);
+	}
 }
 
+//Size scales the glyph relative to the size the font was rasterized at.
+//Bitmap glyphs are snapped to whole pixels like stbtt_GetBakedQuad does, distance fields are drawn as they are
 BATCH_INLINE glyph_quad
-get_glyph_quad(unsigned char c, vec2 txt_pos, const font f, const f32 size) {
+get_glyph_quad(const u32 codepoint, vec2 txt_pos, font* f, const f32 size) {
+	const font_glyph fg = font_get_glyph(f, codepoint);
+	const f32 ipw = 1.0f / (f32)f->w;
+	const f32 iph = 1.0f / (f32)f->h;
+
+	f32 x = txt_pos[0] + fg.xoff*size;
+	f32 y = txt_pos[1] + fg.yoff*size;
+	if(!f->sdf) {
+		x = floorf(x + 0.5f);
+		y = floorf(y + 0.5f);
+	}
+
 	glyph_quad g;
+	g.bbmin[0] =  x;
+	g.bbmin[1] = -(y + (f32)(fg.y1 - fg.y0)*size);
 
-	if(c>=32 && c<128) {
-		stbtt_aligned_quad q;
-		stbtt_GetBakedQuad(f.cdata, f.w, f.h, c - 32, &txt_pos[0], &txt_pos[1], &q, 1);
+	g.bbmax[0] =  x + (f32)(fg.x1 - fg.x0)*size;
+	g.bbmax[1] = -y;
 
-		g.bbmin[0] =  q.x0*size;
-		g.bbmin[1] = -q.y1*size;
+	g.uvmin[0] =  fg.x0*ipw;
+	g.uvmin[1] =  fg.y0*iph;
 
-		g.bbmax[0] =  q.x1*size;
-		g.bbmax[1] = -q.y0*size;
+	g.uvmax[0] =  fg.x1*ipw;
+	g.uvmax[1] =  fg.y1*iph;
 
-		g.uvmin[0] =  q.s0;
-		g.uvmin[1] =  q.t0;
+	g.layer = (f32)f->layer;
 
-		g.uvmax[0] =  q.s1;
-		g.uvmax[1] =  q.t1;
-	}
+	txt_pos[0] += fg.xadvance*size;
 	return g;
 }
 
+BATCH_INLINE u32
+font_kern_slot(const font_kern* kerns, const i32 capacity, const u64 key) {
+	const u32 mask = (u32)capacity - 1;
+	u32 i = (u32)((key * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+	while(kerns[i].key && kerns[i].key != key) {
+		i = (i + 1) & mask;
+	}
+
+	return i;
+}
+
+static void
+font_grow_kerns(font* f) {
+	const i32 capacity = f->kern_capacity * 2;
+	font_kern* kerns = (font_kern*)calloc(capacity, sizeof(font_kern));
+
+	for(i32 i=0; i<f->kern_capacity; ++i) {
+		if(f->kerns[i].key) {
+			kerns[font_kern_slot(kerns, capacity, f->kerns[i].key)] = f->kerns[i];
+		}
+	}
+
+	free(f->kerns);
+	f->kerns = kerns;
+	f->kern_capacity = capacity;
+}
+
+//Kerning between two codepoints at the size the font was rasterized at, stb is only asked once per pair
+static f32
+font_kern_advance(font* f, const u32 a, const u32 b) {
+	if(!f->kerns) {
+		return 0.0f;
+	}
+
+	//Codepoints fit in 21 bits
+	const u64 key = (((u64)a << 21) | b) + 1;
+	u32 i = font_kern_slot(f->kerns, f->kern_capacity, key);
+	if(f->kerns[i].key == key) {
+		return f->kerns[i].advance;
+	}
+
+	if((f->kern_count + 1) * 2 > f->kern_capacity) {
+		font_grow_kerns(f);
+		i = font_kern_slot(f->kerns, f->kern_capacity, key);
+	}
+
+	f->kerns[i].key     = key;
+	f->kerns[i].advance = f->scale * stbtt_GetCodepointKernAdvance(&f->info, a, b);
+	++f->kern_count;
+
+	return f->kerns[i].advance;
+}
+
+//Finds where the line starting at it ends, when wrap_width is positive the line is broken at the last space that fits.
+//A word longer than the whole line is broken where it stops fitting
+static text_line
+text_next_line(font* f, const char* it, const char* end, const f32 size, const f32 wrap_width) {
+	text_line line = { it, end, end, 0.0f };
+
+	const char* space = NULL;
+	f32 space_width = 0.0f;
+	f32 pen = 0.0f;
+	u32 prev = 0;
+
+	while(it < end) {
+		const char* glyph_begin = it;
+		const u32 c = utf8_decode(&it);
+		if(c == '\n') {
+			line.end  = glyph_begin;
+			line.next = it;
+			return line;
+		}
+
+		const f32 advance = (prev ? font_kern_advance(f, prev, c) : 0.0f) + font_get_glyph(f, c).xadvance;
+		if(c == ' ') {
+			space = glyph_begin;
+			space_width = line.width;
+		} else if(wrap_width > 0.0f && (pen + advance) * size > wrap_width && glyph_begin != line.begin) {
+			if(space) {
+				line.end   = space;
+				line.next  = space + 1;
+				line.width = space_width;
+			} else {
+				line.end  = glyph_begin;
+				line.next = glyph_begin;
+			}
+			return line;
+		}
+
+		pen += advance;
+		prev = c;
+
+		//Trailing spaces don't count, so aligned lines line up on their last glyph
+		if(c != ' ') {
+			line.width = pen * size;
+		}
+	}
+
+	return line;
+}
+
+//Size of the box the text takes once wrapped, the width is the one of the widest line
+static void
+text_measure(font* f, const char* string, const i32 length, const f32 size, const f32 wrap_width, vec2 dimensions) {
+	const char* end = string + length;
+	const char* it  = string;
+	i32 lines = 0;
+	dimensions[0] = 0.0f;
+
+	do {
+		const text_line line = text_next_line(f, it, end, size, wrap_width);
+		dimensions[0] = line.width > dimensions[0] ? line.width : dimensions[0];
+		it = line.next;
+		++lines;
+	} while(it < end);
+
+	dimensions[1] = lines * f->line_height * size;
+}
+
 BATCH_INLINE void
-make_glyph_quad(quad data, const glyph_quad g) {
-	//Vertices
-	data[0][0] = g.bbmin[0]; data[0][1] = g.bbmin[1];
-	data[1][0] = g.bbmax[0]; data[1][1] = g.bbmin[1];
-	data[2][0] = g.bbmax[0]; data[2][1] = g.bbmax[1];
-	data[3][0] = g.bbmin[0]; data[3][1] = g.bbmax[1];
-
-	//Uvs
-	data[0][2] = g.uvmin[0]; data[0][3] = g.uvmax[1];
-	data[1][2] = g.uvmax[0]; data[1][3] = g.uvmax[1];
-	data[2][2] = g.uvmax[0]; data[2][3] = g.uvmin[1];
-	data[3][2] = g.uvmin[0]; data[3][3] = g.uvmin[1];
-
-	//Texture id
-	data[0][4] = 0.0f;
-	data[1][4] = 0.0f;
-	data[2][4] = 0.0f;
-	data[3][4] = 0.0f;
+make_glyph_instance(glyph_instance* data, const glyph_quad g, const u8 color[4]) {
+	data->pos[0]  = (i16)text_quantize(g.bbmin[0], 4.0f, INT16_MIN, INT16_MAX);
+	data->pos[1]  = (i16)text_quantize(g.bbmin[1], 4.0f, INT16_MIN, INT16_MAX);
+	data->size[0] = (u16)text_quantize(g.bbmax[0] - g.bbmin[0], 4.0f, 0, UINT16_MAX);
+	data->size[1] = (u16)text_quantize(g.bbmax[1] - g.bbmin[1], 4.0f, 0, UINT16_MAX);
+
+	data->uv[0] = (u16)text_quantize(g.uvmin[0], 65535.0f, 0, UINT16_MAX);
+	data->uv[1] = (u16)text_quantize(g.uvmin[1], 65535.0f, 0, UINT16_MAX);
+	data->uv[2] = (u16)text_quantize(g.uvmax[0], 65535.0f, 0, UINT16_MAX);
+	data->uv[3] = (u16)text_quantize(g.uvmax[1], 65535.0f, 0, UINT16_MAX);
+
+	memcpy(data->color, color, sizeof(data->color));
+	data->layer = (u32)g.layer;
+}
+
+//Bars, backgrounds and graphs go through the text batches too, pos is the bottom left corner
+BATCH_INLINE void
+make_solid_instance(glyph_instance* data, const f32 x, const f32 y, const f32 w, const f32 h, const u8 color[4]) {
+	data->pos[0]  = (i16)text_quantize(x, 4.0f, INT16_MIN, INT16_MAX);
+	data->pos[1]  = (i16)text_quantize(y, 4.0f, INT16_MIN, INT16_MAX);
+	data->size[0] = (u16)text_quantize(w, 4.0f, 0, UINT16_MAX);
+	data->size[1] = (u16)text_quantize(h, 4.0f, 0, UINT16_MAX);
+	memset(data->uv, 0, sizeof(data->uv));
+	memcpy(data->color, color, sizeof(data->color));
+	data->layer = TEXT_SOLID_LAYER;
+}
+
+//Inclusive prefix sum of 4 lanes
+BATCH_INLINE __m128
+mm_prefix_sum_ps(__m128 v) {
+	v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 4)));
+	v = _mm_add_ps(v, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(v), 8)));
+	return v;
+}
+
+//floor without sse4.1, truncates then steps down where that went up
+BATCH_INLINE __m128
+mm_floor_ps(const __m128 v) {
+	const __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+	return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+}
+
+/*
+  Places count gathered glyphs, the pen of glyph i is pen_x plus the prefix sum of steps up to i scaled by size.
+  Snapping rounds to whole pixels like get_glyph_quad does for bitmap fonts.
+  Returns the sum of all steps, count is padded up to 8 with zero steps by the caller
+*/
+typedef f32 (*text_place_glyphs_func)(text_bulk* b, const i32 count, const f32 pen_x, const f32 pen_y, const f32 size, const bool snap);
+
+static f32
+text_place_glyphs_sse(text_bulk* b, const i32 count, const f32 pen_x, const f32 pen_y, const f32 size, const bool snap) {
+	const __m128 vsize  = _mm_set1_ps(size);
+	const __m128 vpen_y = _mm_set1_ps(pen_y);
+	const __m128 half   = _mm_set1_ps(0.5f);
+	const __m128 four   = _mm_set1_ps(4.0f);
+	const __m128 pos_lo = _mm_set1_ps(INT16_MIN), pos_hi = _mm_set1_ps(INT16_MAX);
+	const __m128 zero   = _mm_setzero_ps(), size_hi = _mm_set1_ps(UINT16_MAX);
+	__m128 carry = _mm_set1_ps(0.0f);
+
+	for(i32 i=0; i<count; i += 4) {
+		const __m128 sum = _mm_add_ps(mm_prefix_sum_ps(_mm_load_ps(b->step + i)), carry);
+		carry = _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 3, 3));
+
+		const __m128 w = _mm_mul_ps(_mm_load_ps(b->w + i), vsize);
+		const __m128 h = _mm_mul_ps(_mm_load_ps(b->h + i), vsize);
+		__m128 x = _mm_add_ps(_mm_add_ps(_mm_set1_ps(pen_x), _mm_mul_ps(sum, vsize)), _mm_mul_ps(_mm_load_ps(b->xoff + i), vsize));
+		__m128 y = _mm_add_ps(vpen_y, _mm_mul_ps(_mm_load_ps(b->yoff + i), vsize));
+		if(snap) {
+			x = mm_floor_ps(_mm_add_ps(x, half));
+			y = mm_floor_ps(_mm_add_ps(y, half));
+		}
+
+		//The hud y axis points up, the bottom of the glyph is at -(y + h)
+		y = _mm_sub_ps(zero, _mm_add_ps(y, h));
+
+		_mm_store_si128((__m128i*)(b->x + i), _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(x, four), pos_lo), pos_hi)));
+		_mm_store_si128((__m128i*)(b->y + i), _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(y, four), pos_lo), pos_hi)));
+		_mm_store_si128((__m128i*)(b->size_x + i), _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(w, four), zero), size_hi)));
+		_mm_store_si128((__m128i*)(b->size_y + i), _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(h, four), zero), size_hi)));
+	}
+
+	return _mm_cvtss_f32(carry);
+}
+
+BMATH_TARGET_AVX2 static f32
+text_place_glyphs_avx2(text_bulk* b, const i32 count, const f32 pen_x, const f32 pen_y, const f32 size, const bool snap) {
+	const __m256 vsize  = _mm256_set1_ps(size);
+	const __m256 vpen_y = _mm256_set1_ps(pen_y);
+	const __m256 half   = _mm256_set1_ps(0.5f);
+	const __m256 four   = _mm256_set1_ps(4.0f);
+	const __m256 pos_lo = _mm256_set1_ps(INT16_MIN), pos_hi = _mm256_set1_ps(INT16_MAX);
+	const __m256 zero   = _mm256_setzero_ps(), size_hi = _mm256_set1_ps(UINT16_MAX);
+	const __m256i last  = _mm256_set1_epi32(7);
+	__m256 carry = _mm256_setzero_ps();
+
+	for(i32 i=0; i<count; i += 8) {
+		//Prefix sum inside each 128 bit lane, then the total of the low lane is added to the high one
+		__m256 sum = _mm256_load_ps(b->step + i);
+		sum = _mm256_add_ps(sum, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(sum), 4)));
+		sum = _mm256_add_ps(sum, _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(sum), 8)));
+		const __m256 low_total = _mm256_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 3, 3));
+		sum = _mm256_add_ps(sum, _mm256_permute2f128_ps(low_total, low_total, 0x08));
+		sum = _mm256_add_ps(sum, carry);
+		carry = _mm256_permutevar8x32_ps(sum, last);
+
+		const __m256 w = _mm256_mul_ps(_mm256_load_ps(b->w + i), vsize);
+		const __m256 h = _mm256_mul_ps(_mm256_load_ps(b->h + i), vsize);
+		__m256 x = _mm256_add_ps(_mm256_add_ps(_mm256_set1_ps(pen_x), _mm256_mul_ps(sum, vsize)), _mm256_mul_ps(_mm256_load_ps(b->xoff + i), vsize));
+		__m256 y = _mm256_add_ps(vpen_y, _mm256_mul_ps(_mm256_load_ps(b->yoff + i), vsize));
+		if(snap) {
+			x = _mm256_floor_ps(_mm256_add_ps(x, half));
+			y = _mm256_floor_ps(_mm256_add_ps(y, half));
+		}
+
+		y = _mm256_sub_ps(zero, _mm256_add_ps(y, h));
+
+		_mm256_store_si256((__m256i*)(b->x + i), _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(x, four), pos_lo), pos_hi)));
+		_mm256_store_si256((__m256i*)(b->y + i), _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(y, four), pos_lo), pos_hi)));
+		_mm256_store_si256((__m256i*)(b->size_x + i), _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(w, four), zero), size_hi)));
+		_mm256_store_si256((__m256i*)(b->size_y + i), _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(h, four), zero), size_hi)));
+	}
+
+	return _mm256_cvtss_f32(carry);
+}
+
+/*
+  Bulk version of get_glyph_quad and make_glyph_instance for a run of text on one line.
+  Metrics are gathered from the glyph and kerning tables first, then positions are worked out in one vector pass.
+  Writes at most max_out instances, it is moved past what was consumed and prev is the last codepoint of it,
+  pen ends after the advance of that codepoint. Returns the number of instances written.
+  place is the kernel that works out the positions, text_build_glyphs picks the one the cpu supports
+*/
+static i32
+text_build_glyphs_with(const text_place_glyphs_func place,
+                       font* f, const char** it, const char* end, u32* prev, vec2 pen, const f32 size,
+                       const u8 color[4], glyph_instance* out, i32 max_out) {
+	__attribute__((aligned(32))) text_bulk b;
+	u16 uvs[TEXT_BULK_GLYPHS][4];
+
+	i32 written = 0;
+	f32 pending = 0.0f;
+
+	while(*it < end && written < max_out) {
+		const i32 chunk = max_out - written < TEXT_BULK_GLYPHS ? max_out - written : TEXT_BULK_GLYPHS;
+
+		//Gather, spaces only add to the step of the next visible glyph
+		i32 n = 0;
+		while(*it < end && n < chunk) {
+			const char* next = *it;
+			const u32 c = utf8_decode(&next);
+			if(*prev) {
+				pending += font_kern_advance(f, *prev, c);
+			}
+
+			const font_glyph fg = font_get_glyph(f, c);
+			if(c != ' ') {
+				b.step[n] = pending;
+				b.xoff[n] = fg.xoff;
+				b.yoff[n] = fg.yoff;
+				b.w[n]    = (f32)(fg.x1 - fg.x0);
+				b.h[n]    = (f32)(fg.y1 - fg.y0);
+				memcpy(uvs[n], fg.uv, sizeof(fg.uv));
+				pending = fg.xadvance;
+				++n;
+			} else {
+				pending += fg.xadvance;
+			}
+
+			*prev = c;
+			*it = next;
+		}
+
+		if(!n) {
+			break;
+		}
+
+		const i32 padded = (n + 7) & ~7;
+		for(i32 i=n; i<padded; ++i) {
+			b.step[i] = b.xoff[i] = b.yoff[i] = b.w[i] = b.h[i] = 0.0f;
+		}
+
+		const f32 total = place(&b, padded, pen[0], pen[1], size, !f->sdf);
+		pen[0] += total * size;
+
+		for(i32 i=0; i<n; ++i) {
+			glyph_instance* g = &out[written + i];
+			g->pos[0]  = (i16)b.x[i];
+			g->pos[1]  = (i16)b.y[i];
+			g->size[0] = (u16)b.size_x[i];
+			g->size[1] = (u16)b.size_y[i];
+			memcpy(g->uv, uvs[i], sizeof(g->uv));
+			memcpy(g->color, color, sizeof(g->color));
+			g->layer = (u32)f->layer;
+		}
+		written += n;
+	}
+
+	pen[0] += pending * size;
+	return written;
+}
+
+BATCH_INLINE i32
+text_build_glyphs(font* f, const char** it, const char* end, u32* prev, vec2 pen, const f32 size,
+                  const u8 color[4], glyph_instance* out, i32 max_out) {
+	const text_place_glyphs_func place = bmath_cpu.avx2_fma ? text_place_glyphs_avx2 : text_place_glyphs_sse;
+	return text_build_glyphs_with(place, f, it, end, prev, pen, size, color, out, max_out);
 }
 
 BATCH_INLINE void
 free_font(font* f) {
-	free(f->cdata);
-	stbtt_FreeBitmap(f->bitmap, NULL);
+	free(f->glyphs);
+	free(f->kerns);
+	free(f->scratch);
+	file_unmap(f->file);
+	free(f->cache_path);
+	*f = (font){};
+}
+
+//Every stream region has its own copy of the glyphs, so a change has to reach all of them.
+//Dirty ranges are kept per object and per region in absolute glyph indices, empty when begin == end
+BATCH_INLINE void
+text_mark_dirty(text_object* obj, const i32 begin, const i32 end) {
+	if(begin >= end) {
+		return;
+	}
+
+	for(i32 r=0; r<STREAM_BUFFER_REGIONS; ++r) {
+		if(obj->dirty_begin[r] == obj->dirty_end[r]) {
+			obj->dirty_begin[r] = begin;
+			obj->dirty_end[r]   = end;
+		} else {
+			obj->dirty_begin[r] = begin < obj->dirty_begin[r] ? begin : obj->dirty_begin[r];
+			obj->dirty_end[r]   = end > obj->dirty_end[r] ? end : obj->dirty_end[r];
+		}
+	}
 }
 
-static inline void
-make_text_row(font f, vec2 txt_pos, i32* av_vertice, u32* index_count, quad quad_arr[], const char* msg, ...) {
-	__builtin_va_list arg_ptr;
-	va_start(arg_ptr, msg);
+BATCH_INLINE void
+text_clear_dirty(text_object* obj) {
+	memset(obj->dirty_begin, 0, sizeof(obj->dirty_begin));
+	memset(obj->dirty_end, 0, sizeof(obj->dirty_end));
+}
 
-	char message[100];
-	memset(message, 0, sizeof(message));
+static text_batch
+text_batch_init(const i32 max_glyphs, const i32 max_objects) {
+	text_batch batch = {};
+	batch.glyphs      = (glyph_instance*)calloc(max_glyphs, sizeof(glyph_instance));
+	batch.max_glyphs  = max_glyphs;
+	batch.objects     = (text_object*)calloc(max_objects, sizeof(text_object));
+	batch.max_objects = max_objects;
 
-	vsnprintf(message, 100, msg, arg_ptr);
-	va_end(arg_ptr);
+	return batch;
+}
 
-	for(i32 i=0; i < 100; ++i) {
-		const char c = message[i];
-		if(!c) { break; };
-		const glyph_quad g = get_glyph_quad(c, txt_pos, f, 1.0f);
-		if(c != ' ') {
-			make_glyph_quad(quad_arr[*av_vertice], g);
-			*index_count+=6;
-			++(*av_vertice);
+static void
+text_batch_free(text_batch* batch) {
+	for(i32 i=0; i<batch->object_count; ++i) {
+		free(batch->objects[i].string);
+	}
+	free(batch->objects);
+	free(batch->glyphs);
+	*batch = (text_batch){};
+}
+
+//Hands the span of obj over to dead, zeroed and dirty so the clearing still gets uploaded
+BATCH_INLINE void
+text_retire_span(text_batch* batch, text_object* dead, const text_object* obj) {
+	dead->first    = obj->first;
+	dead->capacity = obj->capacity;
+	memset(&batch->glyphs[dead->first], 0, sizeof(glyph_instance) * obj->count);
+	memcpy(dead->dirty_begin, obj->dirty_begin, sizeof(dead->dirty_begin));
+	memcpy(dead->dirty_end, obj->dirty_end, sizeof(dead->dirty_end));
+	text_mark_dirty(dead, obj->first, obj->first + obj->count);
+}
+
+//Gives the object a span of at least count glyphs, reusing spans left by destroyed or moved objects first.
+//A moved object starts with count 0 since its new span is already zeroed
+static bool
+text_reserve_span(text_batch* batch, text_object* obj, const i32 count) {
+	if(count <= obj->capacity) {
+		return true;
+	}
+
+	for(i32 i=0; i<batch->object_count; ++i) {
+		text_object* dead = &batch->objects[i];
+		if(!dead->alive && dead != obj && dead->capacity >= count) {
+			const text_object reused = *dead;
+			text_retire_span(batch, dead, obj);
+
+			//The regions may still hold what the dead object had, so its pending ranges carry over
+			obj->first    = reused.first;
+			obj->capacity = reused.capacity;
+			obj->count    = 0;
+			memcpy(obj->dirty_begin, reused.dirty_begin, sizeof(obj->dirty_begin));
+			memcpy(obj->dirty_end, reused.dirty_end, sizeof(obj->dirty_end));
+			return true;
 		}
 	}
+
+	//Some slack so small changes like a counter growing a digit don't move the span
+	const i32 capacity = (count + 7) & ~7;
+	const bool has_old_span = obj->capacity > 0;
+	if(batch->glyph_count + capacity > batch->max_glyphs ||
+	   (has_old_span && batch->object_count == batch->max_objects)) {
+		printf("Text batch is full, text will be truncated\n");
+		return false;
+	}
+
+	//The old span is handed to a new dead object so it's cleared on the gpu and can be reused later
+	if(has_old_span) {
+		text_object* dead = &batch->objects[batch->object_count++];
+		*dead = (text_object){};
+		text_retire_span(batch, dead, obj);
+	}
+
+	//Regions never saw this span, the whole of it has to go up once
+	obj->first    = batch->glyph_count;
+	obj->capacity = capacity;
+	obj->count    = 0;
+	batch->glyph_count += capacity;
+	text_clear_dirty(obj);
+	text_mark_dirty(obj, obj->first, obj->first + capacity);
+	return true;
+}
+
+//Lays the text out over the cached glyphs and only marks dirty the ones whose bytes changed
+static void
+text_layout(text_batch* batch, text_object* obj) {
+	const char* end = obj->string + obj->length;
+
+	i32 visible = 0;
+	for(const char* it = obj->string; it < end;) {
+		const u32 c = utf8_decode(&it);
+		visible += c != ' ' && c != '\n';
+	}
+
+	if(!text_reserve_span(batch, obj, visible)) {
+		visible = obj->capacity;
+	}
+
+	//Aligned text without wrapping is aligned to its widest line
+	f32 box_width = obj->wrap_width;
+	if(obj->align != TEXT_ALIGN_LEFT && box_width <= 0.0f) {
+		vec2 dimensions;
+		text_measure(obj->f, obj->string, obj->length, obj->size, 0.0f, dimensions);
+		box_width = dimensions[0];
+	}
+
+	i32 changed_begin = obj->capacity;
+	i32 changed_end   = 0;
+
+	i32 n = 0;
+	f32 line_y = obj->pos[1];
+	const char* line_it = obj->string;
+	do {
+		const text_line line = text_next_line(obj->f, line_it, end, obj->size, obj->wrap_width);
+
+		vec2 txt_pos = { obj->pos[0], line_y };
+		if(obj->align == TEXT_ALIGN_CENTER) {
+			txt_pos[0] += (box_width - line.width) * 0.5f;
+		} else if(obj->align == TEXT_ALIGN_RIGHT) {
+			txt_pos[0] += box_width - line.width;
+		}
+
+		u32 prev = 0;
+		const char* it = line.begin;
+		while(it < line.end && n<visible) {
+			glyph_instance chunk[TEXT_BULK_GLYPHS];
+			const i32 max_out = visible - n < TEXT_BULK_GLYPHS ? visible - n : TEXT_BULK_GLYPHS;
+			const i32 built = text_build_glyphs(obj->f, &it, line.end, &prev, txt_pos, obj->size, obj->color, chunk, max_out);
+			if(!built) {
+				break;
+			}
+
+			for(i32 i=0; i<built; ++i, ++n) {
+				if(memcmp(&chunk[i], &batch->glyphs[obj->first + n], sizeof(glyph_instance))) {
+					batch->glyphs[obj->first + n] = chunk[i];
+					changed_begin = n < changed_begin ? n : changed_begin;
+					changed_end   = n + 1;
+				}
+			}
+		}
+
+		line_y += obj->f->line_height * obj->size;
+		line_it = line.next;
+	} while(line_it < end);
+
+	//Glyphs past the end are zero already, only the ones left by a longer string need clearing
+	if(obj->count > n) {
+		memset(&batch->glyphs[obj->first + n], 0, sizeof(glyph_instance) * (obj->count - n));
+		changed_begin = n < changed_begin ? n : changed_begin;
+		changed_end   = obj->count;
+	}
+
+	obj->count = n;
+	text_mark_dirty(obj, obj->first + changed_begin, obj->first + changed_end);
+}
+
+//Formats into buffer when it fits, otherwise into a heap string that has to be freed when it isn't buffer
+static char*
+text_vformat(char* buffer, const i32 buffer_size, i32* length, const char* fmt, __builtin_va_list args) {
+	__builtin_va_list args_copy;
+	va_copy(args_copy, args);
+	*length = vsnprintf(buffer, buffer_size, fmt, args);
+
+	char* formatted = buffer;
+	if(*length >= buffer_size) {
+		formatted = (char*)malloc(*length + 1);
+		vsnprintf(formatted, *length + 1, fmt, args_copy);
+	}
+	va_end(args_copy);
+
+	return formatted;
+}
+
+//Returns true if the string changed
+static bool
+text_set_string(text_object* obj, const char* fmt, __builtin_va_list args) {
+	char buffer[256];
+	i32 length;
+	char* formatted = text_vformat(buffer, sizeof(buffer), &length, fmt, args);
+
+	bool changed = length != obj->length || memcmp(formatted, obj->string, length) != 0;
+	if(changed) {
+		if(length + 1 > obj->string_capacity) {
+			obj->string_capacity = length + 1;
+			obj->string = (char*)realloc(obj->string, obj->string_capacity);
+		}
+		memcpy(obj->string, formatted, length + 1);
+		obj->length = length;
+	}
+
+	if(formatted != buffer) {
+		free(formatted);
+	}
+
+	return changed;
+}
+
+static text_handle
+text_create(text_batch* batch, font* f, const vec2 pos, const char* fmt, ...) {
+	text_handle handle = TEXT_INVALID_HANDLE;
+	for(i32 i=0; i<batch->object_count; ++i) {
+		if(!batch->objects[i].alive) {
+			handle = i;
+			break;
+		}
+	}
+
+	if(handle == TEXT_INVALID_HANDLE) {
+		if(batch->object_count == batch->max_objects) {
+			printf("Too many text objects\n");
+			return TEXT_INVALID_HANDLE;
+		}
+		handle = batch->object_count++;
+	}
+
+	text_object* obj = &batch->objects[handle];
+	obj->f          = f;
+	obj->size       = 1.0f;
+	memset(obj->color, 0xff, sizeof(obj->color));
+	obj->alive      = true;
+	obj->length     = -1;
+	obj->wrap_width = 0.0f;
+	obj->align      = TEXT_ALIGN_LEFT;
+	vec2_copy(pos, obj->pos);
+
+	__builtin_va_list args;
+	va_start(args, fmt);
+	text_set_string(obj, fmt, args);
+	va_end(args);
+
+	text_layout(batch, obj);
+
+	return handle;
+}
+
+//Formats the string and lays the text out again only if it's different from the current one
+static void
+text_set(text_batch* batch, const text_handle handle, const char* fmt, ...) {
+	text_object* obj = &batch->objects[handle];
+
+	__builtin_va_list args;
+	va_start(args, fmt);
+	const bool changed = text_set_string(obj, fmt, args);
+	va_end(args);
+
+	if(changed) {
+		text_layout(batch, obj);
+	}
+}
+
+static void
+text_set_pos(text_batch* batch, const text_handle handle, const vec2 pos) {
+	text_object* obj = &batch->objects[handle];
+
+	if(obj->pos[0] != pos[0] || obj->pos[1] != pos[1]) {
+		vec2_copy(pos, obj->pos);
+		text_layout(batch, obj);
+	}
+}
+
+//Size is relative to the size the font was rasterized at
+static void
+text_set_font(text_batch* batch, const text_handle handle, font* f, const f32 size) {
+	text_object* obj = &batch->objects[handle];
+
+	if(obj->f != f || obj->size != size) {
+		obj->f    = f;
+		obj->size = size;
+		text_layout(batch, obj);
+	}
+}
+
+static void
+text_set_color(text_batch* batch, const text_handle handle, const u8 color[4]) {
+	text_object* obj = &batch->objects[handle];
+
+	if(memcmp(obj->color, color, sizeof(obj->color))) {
+		memcpy(obj->color, color, sizeof(obj->color));
+		text_layout(batch, obj);
+	}
+}
+
+//Wraps the text at wrap_width, 0 keeps it on the lines it has, align is relative to the wrap width
+static void
+text_set_box(text_batch* batch, const text_handle handle, const f32 wrap_width, const text_align align) {
+	text_object* obj = &batch->objects[handle];
+
+	if(obj->wrap_width != wrap_width || obj->align != align) {
+		obj->wrap_width = wrap_width;
+		obj->align      = align;
+		text_layout(batch, obj);
+	}
+}
+
+//The span is kept so the next text created can reuse it
+static void
+text_destroy(text_batch* batch, const text_handle handle) {
+	text_object* obj = &batch->objects[handle];
+
+	memset(&batch->glyphs[obj->first], 0, sizeof(glyph_instance) * obj->count);
+	text_mark_dirty(obj, obj->first, obj->first + obj->count);
+	obj->alive  = false;
+	obj->count  = 0;
+	obj->length = 0;
+}
+
+//Copies the glyphs that changed since region was last written and updates the high water mark,
+//returns the number of glyphs to draw, nothing past the last glyph of a live text is drawn
+static i32
+text_batch_upload(text_batch* batch, glyph_instance* dest, const u32 region) {
+	i32 copied = 0;
+	i32 high_water = 0;
+
+	for(i32 i=0; i<batch->object_count; ++i) {
+		text_object* obj = &batch->objects[i];
+		const i32 begin = obj->dirty_begin[region];
+		const i32 end   = obj->dirty_end[region];
+		if(end > begin) {
+			memcpy(&dest[begin], &batch->glyphs[begin], sizeof(glyph_instance) * (end - begin));
+			obj->dirty_begin[region] = 0;
+			obj->dirty_end[region]   = 0;
+			copied += end - begin;
+		}
+
+		if(obj->alive && obj->first + obj->count > high_water) {
+			high_water = obj->first + obj->count;
+		}
+	}
+
+	batch->high_water     = high_water;
+	batch->uploaded_bytes = (u32)(sizeof(glyph_instance) * copied);
+	return high_water;
+}
+
+static void
+text_stream_begin(text_stream* stream, stream_buffer* sb, text_flush_func flush, void* user_data) {
+	stream->sb          = sb;
+	stream->region      = NULL;
+	stream->count       = 0;
+	stream->capacity    = sb->region_size / sizeof(glyph_instance);
+	stream->flush       = flush;
+	stream->user_data   = user_data;
+	stream->flush_count = 0;
+	stream->total       = 0;
+}
+
+//Draws what's pending and gives the region back, the next region is only waited on when a glyph needs it
+static void
+text_stream_flush(text_stream* stream) {
+	if(stream->count > 0) {
+		stream->flush(stream->sb, stream->count, stream->user_data);
+		stream_buffer_end(stream->sb);
+		stream->total += stream->count;
+		++stream->flush_count;
+	}
+
+	stream->region = NULL;
+	stream->count  = 0;
+}
+
+BATCH_INLINE void
+text_stream_push(text_stream* stream, const glyph_instance* glyph) {
+	if(stream->count == stream->capacity) {
+		text_stream_flush(stream);
+	}
+	if(!stream->region) {
+		stream->region = (glyph_instance*)stream_buffer_begin(stream->sb);
+	}
+
+	stream->region[stream->count++] = *glyph;
+}
+
+BATCH_INLINE void
+text_stream_end(text_stream* stream) {
+	if(stream->count > 0) {
+		text_stream_flush(stream);
+	}
+}
+
+//Immediate text of any length, pos is moved to the start of the line after the last one written
+static void
+text_stream_print(text_stream* stream, font* f, vec2 pos, const f32 size, const u8 color[4], const char* fmt, ...) {
+	char buffer[256];
+	i32 length;
+	__builtin_va_list args;
+	va_start(args, fmt);
+	char* formatted = text_vformat(buffer, sizeof(buffer), &length, fmt, args);
+	va_end(args);
+
+	const char* end = formatted + length;
+	f32 line_y = pos[1];
+
+	for(const char* line = formatted;; line_y += f->line_height * size) {
+		const char* line_end = (const char*)memchr(line, '\n', end - line);
+		if(!line_end) {
+			line_end = end;
+		}
+
+		vec2 txt_pos = { pos[0], line_y };
+		u32 prev = 0;
+		const char* it = line;
+		while(it < line_end) {
+			glyph_instance chunk[TEXT_BULK_GLYPHS];
+			const i32 built = text_build_glyphs(f, &it, line_end, &prev, txt_pos, size, color, chunk, TEXT_BULK_GLYPHS);
+			for(i32 i=0; i<built; ++i) {
+				text_stream_push(stream, &chunk[i]);
+			}
+		}
+
+		if(line_end == end) {
+			break;
+		}
+		line = line_end + 1;
+	}
+
+	pos[1] = line_y + f->line_height * size;
+
+	if(formatted != buffer) {
+		free(formatted);
+	}
+}
+
+/*
+  Times the per glyph path against the bulk one on the same string and prints glyphs per second.
+  Both paths write into a scratch array so only layout is measured, every glyph is rasterized before timing
+*/
+static void
+text_bench(font* f, const f32 size) {
+	const char* sample = "The quick brown fox jumps over the lazy dog, AVAWATo 0123456789 ";
+	enum { TEXT_BENCH_REPEAT = 64, TEXT_BENCH_RUNS = 200 };
+
+	const i32 sample_length = (i32)strlen(sample);
+	const i32 length = sample_length * TEXT_BENCH_REPEAT;
+	char* string = (char*)malloc(length);
+	for(i32 i=0; i<TEXT_BENCH_REPEAT; ++i) {
+		memcpy(string + i * sample_length, sample, sample_length);
+	}
+	const char* end = string + length;
+
+	glyph_instance* out = (glyph_instance*)malloc(sizeof(glyph_instance) * length);
+	const u8 color[4] = { 255, 255, 255, 255 };
+	const bool has_avx2_fma = bmath_cpu.avx2_fma;
+	const f64 frequency = (f64)SDL_GetPerformanceFrequency();
+
+	//0 is the per glyph path, 1 bulk with sse, 2 bulk with avx2
+	const char* names[3] = { "per glyph", "bulk sse", "bulk avx2" };
+	i32 glyph_count = 0;
+	u32 checksum = 0;
+	for(i32 path=0; path<3; ++path) {
+		if(path == 2 && !has_avx2_fma) {
+			printf("Text bench %-10s: not supported by this cpu\n", names[path]);
+			continue;
+		}
+		const text_place_glyphs_func place = path == 2 ? text_place_glyphs_avx2 : text_place_glyphs_sse;
+
+		u64 best = UINT64_MAX;
+		for(i32 run=0; run<TEXT_BENCH_RUNS; ++run) {
+			const u64 begin = SDL_GetPerformanceCounter();
+
+			vec2 pen = { 0.0f, 0.0f };
+			u32 prev = 0;
+			i32 n = 0;
+			if(path == 0) {
+				for(const char* it = string; it < end;) {
+					const u32 c = utf8_decode(&it);
+					if(prev) {
+						pen[0] += font_kern_advance(f, prev, c) * size;
+					}
+
+					const glyph_quad g = get_glyph_quad(c, pen, f, size);
+					if(c != ' ') {
+						make_glyph_instance(&out[n++], g, color);
+					}
+					prev = c;
+				}
+			} else {
+				const char* it = string;
+				while(it < end) {
+					n += text_build_glyphs_with(place, f, &it, end, &prev, pen, size, color, out + n, length - n);
+				}
+			}
+
+			const u64 ticks = SDL_GetPerformanceCounter() - begin;
+			best = ticks < best ? ticks : best;
+			glyph_count = n;
+			checksum += out[n - 1].pos[0];
+		}
+
+		const f64 seconds = (f64)best / frequency;
+		printf("Text bench %-10s: %d glyphs in %.3f ms, %.1f M glyphs/s\n",
+		       names[path], glyph_count, seconds * 1000.0, glyph_count / seconds / 1000000.0);
+	}
+
+	printf("Text bench checksum: %u\n", checksum);
+
+	free(out);
+	free(string);
 }
@@ -6,15 +6,197 @@ typedef struct {
 	vec2 bbmax;
 	vec2 uvmin;
 	vec2 uvmax;
+	f32  layer;
 } glyph_quad;
 
+/*
+  Every font gets a layer of one texture array, so texts in different fonts still go in a single draw.
+  Layers all have the same size, the registry hands them out in order and knows which ones hold distance fields.
+*/
+//Glyph instances with this layer are drawn as solid quads of their color, registries never have this many layers
+#define TEXT_SOLID_LAYER 32
+
+typedef struct {
+	texture atlas;
+	i32     w;
+	i32     h;
+	i32     layer_count;
+	i32     max_layers;
+	u32     sdf_layers;   //Bit per layer
+} font_registry;
+
+/*
+  Glyphs are rasterized the first time they're used and packed into the atlas on shelves,
+  a shelf is a row as tall as the first glyph placed on it, glyphs go left to right until the row is full.
+  Only the rectangle of the new glyph is uploaded to the font's layer.
+  Sdf fonts store distances to the glyph edge instead of coverage, so one small atlas can be drawn at any size.
+*/
+typedef struct {
+	u32 key;      //Codepoint + 1, 0 means the slot is empty
+	i16 x0, y0;   //Rectangle in the atlas
+	i16 x1, y1;
+	u16 uv[4];    //Rectangle as unorm, ready for a glyph_instance
+	f32 xoff;
+	f32 yoff;
+	f32 xadvance;
+} font_glyph;
+
+typedef struct {
+	u64 key;      //Both codepoints + 1, 0 means the slot is empty
+	f32 advance;
+} font_kern;
+
 typedef struct {
-	i32              num_glyphs;
-	i32              size;
-	i32              w;
-	i32              h;
-	u8*              bitmap;
-	stbtt_bakedchar* cdata;
+	stbtt_fontinfo info;
+	file_mapping*  file;    //Shared by every font made from the same file
+	f32            scale;
+	f32            line_height;
+	i32            size;
+	bool           sdf;
+	i32            w;
+	i32            h;
+	texture        atlas;   //Owned by the registry
+	i32            layer;
+
+	//Shelf packer state
+	i32            shelf_x;
+	i32            shelf_y;
+	i32            shelf_h;
+
+	//Open addressing table from codepoint to glyph
+	font_glyph*    glyphs;
+	i32            glyph_count;
+	i32            glyph_capacity;
+
+	//Same for kerning pairs, left NULL when the font has no kerning at all
+	font_kern*     kerns;
+	i32            kern_count;
+	i32            kern_capacity;
+
+	u8*            scratch;
+	i32            scratch_size;
+
+	//On disk copy of the glyphs, see font_cache_header
+	u64            hash;
+	char*          cache_path;
+	i32            cached_glyph_count;
 } font;
 
+/*
+  Rasterized glyphs are kept on disk so later runs upload them instead of running stb_truetype again.
+  The file is this header, the glyph table exactly as it is in memory and the used rows of the font's layer.
+  Every field up to glyph_capacity is a key, a file that doesn't match all of them is ignored and written again.
+*/
+#define FONT_CACHE_MAGIC   0x48434642u //"BFCH"
+#define FONT_CACHE_VERSION 1
+
+typedef struct {
+	u32 magic;
+	u32 version;
+	u64 font_hash;
+	i32 size;
+	i32 sdf;
+	i32 w;
+	i32 h;
+	i32 glyph_padding;
+	i32 sdf_padding;
+	i32 glyph_size;     //sizeof(font_glyph)
+	i32 glyph_capacity;
+	i32 glyph_count;
+	i32 shelf_x;
+	i32 shelf_y;
+	i32 shelf_h;
+	i32 pixel_rows;
+	i32 reserved;
+} font_cache_header;
+
+/*
+  Retained text, the glyph instances of every text object are laid out once and cached in the batch,
+  they're only laid out again when the string or the position changes.
+  Every object owns a span of glyphs in the batch, unused glyphs of the span are left zeroed so they draw nothing.
+*/
+typedef i32 text_handle;
+
+typedef enum {
+	TEXT_ALIGN_LEFT,
+	TEXT_ALIGN_CENTER,
+	TEXT_ALIGN_RIGHT,
+} text_align;
+
+//A line of laid out text, end stops before the space or newline it was broken at
+typedef struct {
+	const char* begin;
+	const char* end;
+	const char* next;
+	f32         width;
+} text_line;
+
+#define TEXT_INVALID_HANDLE -1
+
+typedef struct {
+	font*       f;
+	f32         size;
+	u8          color[4];
+	vec2        pos;
+	f32         wrap_width;  //0 doesn't wrap
+	text_align  align;
+	char*       string;
+	i32         length;
+	i32         string_capacity;
+	i32         first;
+	i32         count;
+	i32         capacity;
+	//Glyphs changed since each stream buffer region was last written
+	i32         dirty_begin[STREAM_BUFFER_REGIONS];
+	i32         dirty_end[STREAM_BUFFER_REGIONS];
+	bool        alive;
+} text_object;
+
+typedef struct {
+	glyph_instance* glyphs;
+	i32             glyph_count;
+	i32             max_glyphs;
+	text_object*    objects;
+	i32             object_count;
+	i32             max_objects;
+	i32             high_water;     //One past the last glyph of any live text
+	u32             uploaded_bytes; //Bytes copied by the last upload
+} text_batch;
+
+/*
+  Metrics of a run of visible glyphs gathered from the font, placed all at once by text_place_glyphs.
+  step is the unscaled distance from the previous glyph, kerning and skipped spaces included.
+  The outputs are in quarter units, ready for a glyph_instance.
+*/
+#define TEXT_BULK_GLYPHS 64
+
+typedef struct {
+	f32 step[TEXT_BULK_GLYPHS];
+	f32 xoff[TEXT_BULK_GLYPHS];
+	f32 yoff[TEXT_BULK_GLYPHS];
+	f32 w[TEXT_BULK_GLYPHS];
+	f32 h[TEXT_BULK_GLYPHS];
+	i32 x[TEXT_BULK_GLYPHS];
+	i32 y[TEXT_BULK_GLYPHS];
+	i32 size_x[TEXT_BULK_GLYPHS];
+	i32 size_y[TEXT_BULK_GLYPHS];
+} text_bulk;
+
+/*
+  Immediate text for things like logs and consoles, glyphs go straight into a stream buffer region.
+  When a region is full flush draws it and the next glyphs continue in a fresh one, so any amount of text fits.
+*/
+typedef void (*text_flush_func)(const stream_buffer* sb, const i32 count, void* user_data);
+
+typedef struct {
+	stream_buffer*  sb;
+	glyph_instance* region;
+	i32             count;
+	i32             capacity;
+	text_flush_func flush;
+	void*           user_data;
+	u32             flush_count;
+	u32             total;
+} text_stream;
+
 #endif
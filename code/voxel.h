@@ -0,0 +1,202 @@
+#if !defined(VOXEL_H)
+#define VOXEL_H
+
+/*
+  Grid aligned unit cubes meshed as a whole instead of cube by cube.
+  Faces between two solid cells are dropped and the remaining coplanar faces are merged
+  greedily into the biggest rectangles possible, uvs go past 1 so the texture repeats per cell.
+*/
+
+typedef struct {
+	i32 dims[3];
+	u8* cells;
+} voxel_volume;
+
+typedef struct {
+	scene_vertex* vertices;
+	u32*          indices;
+	i32           vertex_count;
+	i32           index_count;
+	i32           vertex_capacity;
+	i32           index_capacity;
+	i32           quad_count;
+} voxel_mesh;
+
+BATCH_INLINE voxel_volume
+voxel_volume_init(const i32 x, const i32 y, const i32 z) {
+	voxel_volume vol;
+	vol.dims[0] = x;
+	vol.dims[1] = y;
+	vol.dims[2] = z;
+	vol.cells = (u8*)calloc((size_t)x * y * z, 1);
+
+	return vol;
+}
+
+BATCH_INLINE void
+voxel_volume_free(voxel_volume* vol) {
+	free(vol->cells);
+	vol->cells = NULL;
+}
+
+BATCH_INLINE u8*
+voxel_cell(const voxel_volume* vol, const i32 x, const i32 y, const i32 z) {
+	return &vol->cells[((size_t)y * vol->dims[2] + z) * vol->dims[0] + x];
+}
+
+BATCH_INLINE const bool
+voxel_solid(const voxel_volume* vol, const i32 p[3]) {
+	return *voxel_cell(vol, p[0], p[1], p[2]) != 0;
+}
+
+BATCH_INLINE void
+voxel_mesh_free(voxel_mesh* mesh) {
+	free(mesh->vertices);
+	free(mesh->indices);
+	*mesh = (voxel_mesh){};
+}
+
+static void
+voxel_mesh_push_quad(voxel_mesh* mesh, const vec3 corners[4], const f32 w, const f32 h) {
+	if(mesh->vertex_count + 4 > mesh->vertex_capacity) {
+		mesh->vertex_capacity = mesh->vertex_capacity ? mesh->vertex_capacity * 2 : 1024;
+		mesh->vertices = (scene_vertex*)realloc(mesh->vertices, sizeof(scene_vertex) * mesh->vertex_capacity);
+	}
+	if(mesh->index_count + 6 > mesh->index_capacity) {
+		mesh->index_capacity = mesh->index_capacity ? mesh->index_capacity * 2 : 1536;
+		mesh->indices = (u32*)realloc(mesh->indices, sizeof(u32) * mesh->index_capacity);
+	}
+
+	const f32 uvs[4][2] = { { 0.0f, 0.0f }, { w, 0.0f }, { w, h }, { 0.0f, h } };
+	const u32 first = mesh->vertex_count;
+
+	for(i32 i=0; i<4; ++i) {
+		scene_vertex* v = &mesh->vertices[mesh->vertex_count++];
+		vec3_copy(corners[i], v->v.pos);
+		v->v.uv[0] = uvs[i][0];
+		v->v.uv[1] = uvs[i][1];
+	}
+
+	u32* idx = &mesh->indices[mesh->index_count];
+	idx[0] = first + 0; idx[1] = first + 1; idx[2] = first + 2;
+	idx[3] = first + 2; idx[4] = first + 3; idx[5] = first + 0;
+	mesh->index_count += 6;
+	++mesh->quad_count;
+}
+
+//Meshes the whole volume, origin is the position of the corner of cell 0, mesh is cleared first
+static void
+voxel_mesh_build(voxel_mesh* mesh, const voxel_volume* vol, const vec3 origin) {
+	mesh->vertex_count = 0;
+	mesh->index_count  = 0;
+	mesh->quad_count   = 0;
+
+	i32 max_slice = 0;
+	for(i32 d=0; d<3; ++d) {
+		const i32 slice = vol->dims[(d + 1) % 3] * vol->dims[(d + 2) % 3];
+		max_slice = slice > max_slice ? slice : max_slice;
+	}
+
+	//1 = face looking towards +d, -1 = face looking towards -d
+	i8* mask = (i8*)malloc(max_slice);
+
+	for(i32 d=0; d<3; ++d) {
+		const i32 u = (d + 1) % 3;
+		const i32 v = (d + 2) % 3;
+		const i32 du_dim = vol->dims[u];
+		const i32 dv_dim = vol->dims[v];
+
+		i32 x[3] = { 0, 0, 0 };
+		i32 q[3] = { 0, 0, 0 };
+		q[d] = 1;
+
+		//Walk every plane between two slices, including both outer planes
+		for(x[d] = -1; x[d] < vol->dims[d];) {
+			i32 n = 0;
+			for(x[v] = 0; x[v] < dv_dim; ++x[v]) {
+				for(x[u] = 0; x[u] < du_dim; ++x[u]) {
+					const i32 next[3] = { x[0] + q[0], x[1] + q[1], x[2] + q[2] };
+					const bool a = x[d] >= 0 ? voxel_solid(vol, x) : false;
+					const bool b = x[d] < vol->dims[d] - 1 ? voxel_solid(vol, next) : false;
+					mask[n++] = a == b ? 0 : (a ? 1 : -1);
+				}
+			}
+
+			++x[d];
+
+			//Grow every face first along u then along v while the mask matches
+			n = 0;
+			for(i32 j=0; j<dv_dim; ++j) {
+				for(i32 i=0; i<du_dim;) {
+					const i8 c = mask[n];
+					if(!c) {
+						++i;
+						++n;
+						continue;
+					}
+
+					i32 w = 1;
+					while(i + w < du_dim && mask[n + w] == c) {
+						++w;
+					}
+
+					i32 h = 1;
+					for(; j + h < dv_dim; ++h) {
+						bool row_matches = true;
+						for(i32 k=0; k<w; ++k) {
+							if(mask[n + k + h * du_dim] != c) {
+								row_matches = false;
+								break;
+							}
+						}
+						if(!row_matches) {
+							break;
+						}
+					}
+
+					vec3 base;
+					base[d] = origin[d] + (f32)x[d];
+					base[u] = origin[u] + (f32)i;
+					base[v] = origin[v] + (f32)j;
+
+					vec3 du = { 0.0f, 0.0f, 0.0f };
+					vec3 dv = { 0.0f, 0.0f, 0.0f };
+					du[u] = (f32)w;
+					dv[v] = (f32)h;
+
+					vec3 corners[4];
+					vec3_copy(base, corners[0]);
+					vec3_copy(base, corners[1]);
+					vec3_copy(base, corners[2]);
+					vec3_copy(base, corners[3]);
+					vec3_add(du, corners[1]);
+					vec3_add(du, corners[2]);
+					vec3_add(dv, corners[2]);
+					vec3_add(dv, corners[3]);
+
+					//Keep the winding counter clockwise seen from outside the solid
+					if(c > 0) {
+						voxel_mesh_push_quad(mesh, (const vec3*)corners, (f32)w, (f32)h);
+					} else {
+						const vec3 flipped[4] = { { corners[0][0], corners[0][1], corners[0][2] },
+						                          { corners[3][0], corners[3][1], corners[3][2] },
+						                          { corners[2][0], corners[2][1], corners[2][2] },
+						                          { corners[1][0], corners[1][1], corners[1][2] } };
+						voxel_mesh_push_quad(mesh, flipped, (f32)h, (f32)w);
+					}
+
+					for(i32 l=0; l<h; ++l) {
+						memset(&mask[n + l * du_dim], 0, w);
+					}
+
+					i += w;
+					n += w;
+				}
+			}
+		}
+	}
+
+	free(mask);
+}
+
+#endif